@@ -0,0 +1,25 @@
+TEMPLATE = app
+CONFIG += console c++17
+CONFIG -= app_bundle
+CONFIG -= qt
+
+DEFINES += ZMQ_STATIC
+
+LIBS += -L$$PWD/../lib -lws2_32 -lpthread -lIphlpapi -lbcrypt -lzmq
+INCLUDEPATH += $$PWD/../include $$PWD/../ZMQ_SERVER
+
+SOURCES += main.cpp \
+    allocationcounter.cpp
+
+HEADERS += \
+    allocationcounter.h \
+    benchutil.h \
+    coldstorebench.h \
+    contentionbench.h \
+    delimscanbench.h \
+    flathashbench.h \
+    passwordbench.h \
+    snapshotbench.h \
+    timerwheelbench.h \
+    usertablebench.h \
+    walbench.h
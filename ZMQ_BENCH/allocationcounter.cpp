@@ -0,0 +1,54 @@
+#include "allocationcounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<std::size_t> bytesInUse{0};
+std::atomic<std::size_t> allocationsInUse{0};
+
+// Every block starts with its size, padded so the memory handed out stays aligned
+const std::size_t headerSize = alignof(std::max_align_t);
+
+void* allocate(std::size_t size) {
+    void* block = std::malloc(size + headerSize);
+    if (block == nullptr) throw std::bad_alloc();
+    *static_cast<std::size_t*>(block) = size;
+    bytesInUse.fetch_add(size, std::memory_order_relaxed);
+    allocationsInUse.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<char*>(block) + headerSize;
+}
+
+void release(void* data) {
+    if (data == nullptr) return;
+    void* block = static_cast<char*>(data) - headerSize;
+    bytesInUse.fetch_sub(*static_cast<std::size_t*>(block), std::memory_order_relaxed);
+    allocationsInUse.fetch_sub(1, std::memory_order_relaxed);
+    std::free(block);
+}
+
+} // namespace
+
+std::size_t heapBytesInUse() {
+    return bytesInUse.load(std::memory_order_relaxed);
+}
+
+std::size_t heapAllocationsInUse() {
+    return allocationsInUse.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return allocate(size); } catch (...) { return nullptr; }
+}
+void operator delete(void* data) noexcept { release(data); }
+void operator delete[](void* data) noexcept { release(data); }
+void operator delete(void* data, std::size_t) noexcept { release(data); }
+void operator delete[](void* data, std::size_t) noexcept { release(data); }
+void operator delete(void* data, const std::nothrow_t&) noexcept { release(data); }
+void operator delete[](void* data, const std::nothrow_t&) noexcept { release(data); }
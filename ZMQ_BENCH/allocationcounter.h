@@ -0,0 +1,11 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+
+// The bench replaces the global operator new/delete (allocationcounter.cpp) to count the
+// heap memory in use. Bytes are the requested sizes, without the allocator's own overhead.
+std::size_t heapBytesInUse();
+std::size_t heapAllocationsInUse();
+
+#endif // ALLOCATIONCOUNTER_H
@@ -0,0 +1,55 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+// Keeps the compiler from optimizing away a value that is only computed for the benchmark
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+// Runs fn iterations times, three rounds, and returns the best time per call in nanoseconds
+template <typename Fn>
+double nanosPerOp(std::size_t iterations, Fn&& fn) {
+    double best = 0.0;
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < iterations; ++i) fn();
+        double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double perOp = nanos / static_cast<double>(iterations);
+        if (round == 0 || perOp < best) best = perOp;
+    }
+    return best;
+}
+
+inline void printHeader(const std::string& title) {
+    std::cout << "\n== " << title << " ==" << std::endl;
+}
+
+// One result line: label, time per operation and optionally throughput in MB/s
+inline void printResult(const std::string& label, double nanos, std::size_t bytesPerOp = 0) {
+    std::cout << "  " << std::left << std::setw(44) << label << std::right
+              << std::fixed << std::setprecision(1) << std::setw(12) << nanos << " ns/op";
+    if (bytesPerOp > 0) {
+        std::cout << std::setw(12) << (bytesPerOp * 1000.0 / nanos) << " MB/s";
+    }
+    std::cout << std::endl;
+}
+
+// One result line with a plain value, e.g. printValue("bytes per user", 212.4, "B")
+inline void printValue(const std::string& label, double value, const std::string& unit) {
+    std::cout << "  " << std::left << std::setw(44) << label << std::right
+              << std::fixed << std::setprecision(1) << std::setw(12) << value << " " << unit << std::endl;
+}
+
+#endif // BENCHUTIL_H
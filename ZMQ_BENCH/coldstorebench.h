@@ -0,0 +1,82 @@
+#ifndef COLDSTOREBENCH_H
+#define COLDSTOREBENCH_H
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "usermanager.h"
+#include "lsmstore.h"
+#include "allocationcounter.h"
+#include "benchutil.h"
+
+// 2M registered users of which 150k are active: memory and throughput with every user in
+// memory against a cold store that keeps 200k registrations in memory. The sessions
+// (login + logout) go 90% to the active users and 10% to any user, so the cold store
+// loads about one session in ten from disk.
+inline void runColdStoreBench() {
+    const std::size_t userCount = 2000000;
+    const std::size_t activeCount = 150000;
+    const std::size_t hotLimit = 200000;
+    const std::size_t sessionCount = 1000000;
+    const std::string directory = "zmq_bench.cold";
+    printHeader("cold store, " + std::to_string(userCount) + " users, " + std::to_string(activeCount) + " active");
+
+    std::vector<std::string> names;
+    names.reserve(userCount);
+    for (std::size_t i = 0; i < userCount; ++i) names.push_back("client" + std::to_string(i));
+    std::mt19937_64 random(42);
+    std::vector<std::size_t> sessions(sessionCount);
+    for (std::size_t& user : sessions) {
+        user = random() % 10 == 0 ? random() % userCount : random() % activeCount * (userCount / activeCount);
+    }
+
+    for (bool cold : {false, true}) {
+        std::filesystem::remove_all(directory);
+        std::size_t bytesBefore = heapBytesInUse();
+        {
+            ServerStats stats;
+            ChannelRegistry channels;
+            UserManager users(channels);
+            std::unique_ptr<LsmStore> store;
+            if (cold) {
+                store = std::make_unique<LsmStore>(directory, stats);
+                users.attachStore(store.get(), hotLimit);
+            }
+            const char* label = cold ? "hot set of 200k" : "all in memory";
+
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < userCount; ++i) {
+                users.registerUser(names[i], "channel" + std::to_string(i % 100), GeneratedName(i));
+                users.setPasswordOfName(names[i], "secret12");
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printValue(std::string(label) + ", registrations/s", userCount / seconds, "");
+            printValue("  heap after registering", (heapBytesInUse() - bytesBefore) / 1048576.0, "MB");
+
+            std::uint64_t hitsBefore = cold ? store->counters.hits.load() : 0;
+            std::uint64_t loadsBefore = cold ? store->counters.loads.load() : 0;
+            start = std::chrono::steady_clock::now();
+            GeneratedName loggedOut;
+            for (std::size_t user : sessions) {
+                users.logIn(names[user], "secret12");
+                users.logOut(names[user], loggedOut);
+            }
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printValue("  sessions/s", sessionCount / seconds, "");
+            if (cold) {
+                double hits = static_cast<double>(store->counters.hits.load() - hitsBefore);
+                double loads = static_cast<double>(store->counters.loads.load() - loadsBefore);
+                printValue("  hit rate", 100.0 * hits / (hits + loads), "%");
+                printValue("  evicted names", static_cast<double>(store->counters.evictedNames.load()), "");
+                printValue("  runs on disk", static_cast<double>(store->runCount()), "");
+            }
+            printValue("  heap after the sessions", (heapBytesInUse() - bytesBefore) / 1048576.0, "MB");
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+#endif // COLDSTOREBENCH_H
@@ -0,0 +1,115 @@
+#ifndef CONTENTIONBENCH_H
+#define CONTENTIONBENCH_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "usertable.h"
+#include "leftright.h"
+#include "benchutil.h"
+
+// The locking of UserManager before LeftRight: one mutex around the table for every call
+class LockedUserTable {
+private:
+    mutable std::mutex tableMutex;
+    UserTable table;
+
+public:
+    template <typename Fn>
+    auto read(Fn&& fn) const {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        return fn(static_cast<const UserTable&>(table));
+    }
+
+    template <typename Fn>
+    auto write(Fn&& fn) {
+        std::lock_guard<std::mutex> lock(tableMutex);
+        return fn(table);
+    }
+};
+
+// Reader threads do login checks (name -> id -> password) as fast as they can while one
+// writer registers new users at a steady rate. Returns the login checks per second.
+template <typename Users>
+double measureLoginChecks(Users& users, const std::vector<std::string>& names, std::size_t readerCount,
+                          std::size_t registrationsPerSecond, std::size_t& registrations) {
+    const auto duration = std::chrono::milliseconds(1000);
+    std::atomic<bool> running{true};
+    std::atomic<std::uint64_t> checks{0};
+
+    std::vector<std::thread> readers;
+    for (std::size_t r = 0; r < readerCount; ++r) {
+        readers.emplace_back([&, r] {
+            std::uint64_t done = 0;
+            std::size_t index = r * 7919;
+            while (running.load(std::memory_order_relaxed)) {
+                const std::string& name = names[index++ % names.size()];
+                doNotOptimize(users.read([&](const UserTable& table) {
+                    UserId id = table.find(name);
+                    return id != noUser && table.verifyPassword(id, "secret");
+                }));
+                ++done;
+            }
+            checks.fetch_add(done);
+        });
+    }
+
+    std::thread writer([&] {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t written = 0;
+        while (running.load(std::memory_order_relaxed)) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            std::size_t due = static_cast<std::size_t>(
+                std::chrono::duration<double>(elapsed).count() * registrationsPerSecond);
+            if (written >= due) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            std::string name = "new" + std::to_string(written) + "_" + std::to_string(readerCount);
+            users.write([&](UserTable& table) {
+                UserId id = table.add(name, 0, GeneratedName(written));
+                table.setPassword(id, "secret");
+                return id;
+            });
+            ++written;
+        }
+        registrations = written;
+    });
+
+    std::this_thread::sleep_for(duration);
+    running.store(false);
+    for (auto& reader : readers) reader.join();
+    writer.join();
+    return checks.load() / std::chrono::duration<double>(duration).count();
+}
+
+template <typename Users>
+void benchLoginChecks(const char* name, const std::vector<std::string>& names) {
+    std::cout << "  " << name << std::endl;
+    Users users;
+    users.write([&](UserTable& table) {
+        for (std::size_t i = 0; i < names.size(); ++i) table.setPassword(table.add(names[i], 0, GeneratedName(i)), "secret");
+        return 0;
+    });
+    for (std::size_t readers : {std::size_t{1}, std::size_t{4}, std::size_t{16}}) {
+        std::size_t registrations = 0;
+        double perSecond = measureLoginChecks(users, names, readers, 20000, registrations);
+        printValue("    " + std::to_string(readers) + " readers: login checks", perSecond / 1e6, "M/s");
+        printValue("    " + std::to_string(readers) + " readers: registrations", double(registrations), "/s");
+    }
+}
+
+inline void runContentionBench() {
+    printHeader("read contention: login checks against 20k registrations/s (hardware threads: "
+                + std::to_string(std::thread::hardware_concurrency()) + ")");
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < 100000; ++i) names.push_back("client" + std::to_string(i));
+
+    benchLoginChecks<LockedUserTable>("mutex (before)", names);
+    benchLoginChecks<LeftRight<UserTable>>("LeftRight", names);
+}
+
+#endif // CONTENTIONBENCH_H
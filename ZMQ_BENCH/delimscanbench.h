@@ -0,0 +1,93 @@
+#ifndef DELIMSCANBENCH_H
+#define DELIMSCANBENCH_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <benthernet/messages.hpp>
+#include "benchutil.h"
+
+// The find-based chat parser the server used before the message schemas
+inline std::string legacyExtractChatInfo(const std::string& message, std::string& channel, std::string& senderUsername) {
+    std::size_t firstSep = message.find(">");
+    if (firstSep == std::string::npos) return "";
+    std::size_t secondSep = message.find(">", firstSep + 1);
+    if (secondSep == std::string::npos) return "";
+    std::size_t thirdSep = message.find(">", secondSep + 1);
+    if (thirdSep == std::string::npos) return "";
+
+    if (message.substr(0, firstSep) != "chat") return "";
+
+    channel = message.substr(firstSep + 1, secondSep - (firstSep + 1));
+    senderUsername = message.substr(secondSep + 1, thirdSep - (secondSep + 1));
+    return message.substr(thirdSep + 1);
+}
+
+// All delimiter offsets with repeated find_first_of, the find-based way to split every field
+inline std::size_t findAllDelimiters(std::string_view text, std::uint32_t* offsets, std::size_t maxHits) {
+    std::size_t hits = 0;
+    for (std::size_t pos = text.find_first_of(">|"); pos != std::string_view::npos && hits < maxHits;
+         pos = text.find_first_of(">|", pos + 1)) {
+        offsets[hits++] = static_cast<std::uint32_t>(pos);
+    }
+    return hits;
+}
+
+// Chat message with a payload of the given size; the text holds a '>' or '|' every 64 bytes
+inline std::string makeChatMessage(std::size_t payloadSize) {
+    std::string message = "chat>general>User_AbCdEfGh>";
+    for (std::size_t i = 0; i < payloadSize; ++i) {
+        if (i % 64 == 63) message += (i / 64) % 2 ? '|' : '>';
+        else message += static_cast<char>('a' + i % 26);
+    }
+    return message;
+}
+
+inline void runDelimScanBench() {
+    using namespace benthernet;
+    printHeader(std::string("delimiter scanning (runtime kernel: ") + scanKernelName() + ")");
+
+    for (std::size_t payload : {std::size_t{64}, std::size_t{1024}, std::size_t{65536}}) {
+        const std::string message = makeChatMessage(payload);
+        const std::string_view text(message);
+        const std::size_t iterations = payload < 4096 ? 200000 : 5000;
+        std::vector<std::uint32_t> offsets(message.size());
+
+        std::cout << " payload " << payload << " B" << std::endl;
+
+        printResult("parse: find + substr (old extractChatInfo)", nanosPerOp(iterations, [&] {
+            std::string channel, sender;
+            std::string chatText = legacyExtractChatInfo(message, channel, sender);
+            doNotOptimize(chatText);
+        }), message.size());
+
+        printResult("parse: ChatRequest::decode", nanosPerOp(iterations, [&] {
+            ChatRequest::Fields fields;
+            doNotOptimize(ChatRequest::decode(text, fields));
+            doNotOptimize(fields);
+        }), message.size());
+
+        printResult("all offsets: find_first_of", nanosPerOp(iterations, [&] {
+            doNotOptimize(findAllDelimiters(text, offsets.data(), offsets.size()));
+        }), message.size());
+
+        printResult("all offsets: scalar", nanosPerOp(iterations, [&] {
+            doNotOptimize(scanDelimitersScalar(text.data(), text.size(), '>', '|', offsets.data(), offsets.size()));
+        }), message.size());
+
+#ifdef BENTHERNET_SCAN_X86
+        printResult("all offsets: sse2", nanosPerOp(iterations, [&] {
+            doNotOptimize(scanDelimitersSse2(text.data(), text.size(), '>', '|', offsets.data(), offsets.size()));
+        }), message.size());
+
+        if (__builtin_cpu_supports("avx2")) {
+            printResult("all offsets: avx2", nanosPerOp(iterations, [&] {
+                doNotOptimize(scanDelimitersAvx2(text.data(), text.size(), '>', '|', offsets.data(), offsets.size()));
+            }), message.size());
+        }
+#endif
+    }
+}
+
+#endif // DELIMSCANBENCH_H
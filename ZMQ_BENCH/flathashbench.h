@@ -0,0 +1,120 @@
+#ifndef FLATHASHBENCH_H
+#define FLATHASHBENCH_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include "flathashmap.h"
+#include "allocationcounter.h"
+#include "benchutil.h"
+
+// Keys shaped like the server's: "name|channel" registration keys and generated usernames
+inline std::vector<std::string> makeRegistrationKeys(std::size_t count) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        keys.push_back("client" + std::to_string(i) + "|channel" + std::to_string(i % 100));
+    }
+    return keys;
+}
+
+inline std::vector<std::string> makeGeneratedNames(std::size_t count) {
+    static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    std::mt19937_64 random(7);
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string key = "User_";
+        for (int c = 0; c < 8; ++c) key += chars[random() % 62];
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+// Visits every index once in a scattered order (a stride coprime with count)
+struct ScatteredIndex {
+    std::size_t count;
+    std::size_t stride;
+    std::size_t current = 0;
+
+    explicit ScatteredIndex(std::size_t n) : count(n), stride(2654435761u % n) {
+        while (gcd(stride, count) != 1) ++stride;
+    }
+
+    static std::size_t gcd(std::size_t a, std::size_t b) {
+        while (b != 0) { std::size_t t = a % b; a = b; b = t; }
+        return a;
+    }
+
+    std::size_t next() {
+        current += stride;
+        if (current >= count) current -= count;
+        return current;
+    }
+};
+
+template <typename Map, typename Insert, typename Find>
+void benchStringMap(const char* name, const std::vector<std::string>& keys, Insert insert, Find find) {
+    const std::size_t count = keys.size();
+    const std::size_t lookups = count < 2000000 ? count : 2000000;
+
+    std::size_t bytesBefore = heapBytesInUse();
+    Map map;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i) insert(map, keys[i], static_cast<std::uint32_t>(i));
+    double insertNanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    double bytesPerEntry = double(heapBytesInUse() - bytesBefore) / count;
+
+    std::cout << "  " << name << std::endl;
+    printResult("    insert", insertNanos);
+
+    ScatteredIndex hits(count);
+    printResult("    lookup hit (scattered)", nanosPerOp(lookups, [&] {
+        doNotOptimize(find(map, std::string_view(keys[hits.next()])));
+    }));
+
+    std::string missKey = keys[0];
+    missKey[missKey.size() / 2] = '#';
+    ScatteredIndex misses(count);
+    printResult("    lookup miss", nanosPerOp(lookups, [&] {
+        const std::string& key = keys[misses.next()];
+        doNotOptimize(find(map, std::string_view(key).substr(0, key.size() - 1)));
+    }));
+    printValue("    bytes per entry (keys included)", bytesPerEntry, "B");
+}
+
+inline void benchKeyShape(const char* shape, const std::vector<std::string>& keys) {
+    std::cout << " " << shape << ", " << keys.size() << " entries" << std::endl;
+
+    benchStringMap<std::unordered_map<std::string, std::uint32_t>>("std::unordered_map", keys,
+        [](auto& map, const std::string& key, std::uint32_t value) { map.emplace(key, value); },
+        [](const auto& map, std::string_view key) {
+            // No heterogeneous lookup before C++20: the view becomes a std::string first
+            auto it = map.find(std::string(key));
+            return it != map.end() ? it->second : 0u;
+        });
+
+    benchStringMap<FlatHashMap<std::string, std::uint32_t>>("FlatHashMap", keys,
+        [](auto& map, const std::string& key, std::uint32_t value) { map.tryEmplace(key, value); },
+        [](const auto& map, std::string_view key) {
+            const std::uint32_t* value = map.find(key);
+            return value != nullptr ? *value : 0u;
+        });
+}
+
+inline void runFlatHashBench() {
+#ifdef FLATHASHMAP_SSE2
+    printHeader("hash maps (FlatHashMap control bytes: sse2)");
+#else
+    printHeader("hash maps (FlatHashMap control bytes: scalar)");
+#endif
+    for (std::size_t count : {std::size_t{10000}, std::size_t{1000000}, std::size_t{10000000}}) {
+        benchKeyShape("name|channel", makeRegistrationKeys(count));
+        benchKeyShape("User_XXXXXXXX", makeGeneratedNames(count));
+    }
+}
+
+#endif // FLATHASHBENCH_H
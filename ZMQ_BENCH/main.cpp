@@ -0,0 +1,42 @@
+#include <cstring>
+#include <iostream>
+#include "coldstorebench.h"
+#include "contentionbench.h"
+#include "delimscanbench.h"
+#include "flathashbench.h"
+#include "passwordbench.h"
+#include "snapshotbench.h"
+#include "timerwheelbench.h"
+#include "usertablebench.h"
+#include "walbench.h"
+
+// Micro benchmarks for the server's hot paths.
+// Without arguments every benchmark runs; otherwise only the named ones, e.g. ZMQ_BENCH delimscan
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    { "delimscan", runDelimScanBench },
+    { "usertable", runUserTableBench },
+    { "flathash", runFlatHashBench },
+    { "contention", runContentionBench },
+    { "wal", runWalBench },
+    { "snapshot", runSnapshotBench },
+    { "coldstore", runColdStoreBench },
+    { "sessions", runTimerWheelBench },
+    { "passwords", runPasswordBench },
+};
+
+int main(int argc, char* argv[]) {
+    for (const Benchmark& benchmark : benchmarks) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], benchmark.name) == 0) selected = true;
+        }
+        if (selected) benchmark.run();
+    }
+    return 0;
+}
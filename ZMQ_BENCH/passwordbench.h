@@ -0,0 +1,59 @@
+#ifndef PASSWORDBENCH_H
+#define PASSWORDBENCH_H
+
+#include <chrono>
+#include <cstdlib>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "requesthandler.h"
+#include "benchutil.h"
+
+// The password generator before the entropy pool: rand() % 70 per character, which favours
+// the first 32767 % 70 characters and shares the global rand() state between the threads
+inline std::pmr::string oldRandomPassword(int length, std::pmr::memory_resource* resource) {
+    static const std::string_view chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789!@#$%^&*";
+    std::pmr::string password(resource);
+    password.reserve(static_cast<std::size_t>(length));
+    for (int i = 0; i < length; ++i) {
+        password += chars[rand() % chars.size()];
+    }
+    return password;
+}
+
+// Passwords per second over all threads, each making perThread passwords of length
+template <typename Generate>
+double passwordsPerSecond(std::size_t threadCount, std::size_t perThread, int length, Generate generate) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&] {
+            for (std::size_t i = 0; i < perThread; ++i) {
+                std::pmr::string password = generate(length, std::pmr::new_delete_resource());
+                doNotOptimize(password.data());
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(threadCount * perThread) / seconds;
+}
+
+// Passwords of 10, 32 and 128 characters from rand() against the per-thread entropy pool,
+// on one thread and on four (rand() is one shared generator, the pools are not).
+inline void runPasswordBench() {
+    for (int length : {10, 32, 128}) {
+        printHeader("passwords, " + std::to_string(length) + " characters");
+        std::size_t perThread = 4000000 / static_cast<std::size_t>(length);
+        for (std::size_t threads : {std::size_t(1), std::size_t(4)}) {
+            std::string suffix = ", " + std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+            printValue("rand()" + suffix, passwordsPerSecond(threads, perThread, length, oldRandomPassword), "passwords/s");
+            printValue("entropy pool" + suffix, passwordsPerSecond(threads, perThread, length, generateRandomPassword),
+                       "passwords/s");
+        }
+    }
+}
+
+#endif // PASSWORDBENCH_H
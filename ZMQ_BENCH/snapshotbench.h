@@ -0,0 +1,103 @@
+#ifndef SNAPSHOTBENCH_H
+#define SNAPSHOTBENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include "usermanager.h"
+#include "snapshot.h"
+#include "benchutil.h"
+
+inline double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Cold start with 10M registered users (each with a password): replaying the whole
+// write-ahead log against loading a snapshot. Needs about 3 GB of memory and 1.5 GB of disk.
+inline void runSnapshotBench() {
+    const std::size_t userCount = 10000000;
+    const std::string logPath = "zmq_bench.wal";
+    const std::string snapshotPath = "zmq_bench.snap";
+    printHeader("cold start, " + std::to_string(userCount) + " users");
+    std::remove(logPath.c_str());
+    std::remove(snapshotPath.c_str());
+
+    std::uint64_t logSize = 0;
+    {
+        ServerStats stats;
+        ChannelRegistry channels;
+        UserShards shards(1, channels);
+        {
+            WriteAheadLog log(logPath, SyncMode::off, std::chrono::milliseconds(0), stats);
+            shards.attachLog(&log);
+            for (std::size_t i = 0; i < userCount; ++i) {
+                std::string name = "client" + std::to_string(i);
+                UserManager& users = shards.shardForName(name);
+                users.registerUser(name, "channel" + std::to_string(i % 100), GeneratedName(i));
+                users.setPasswordOfName(name, "secret12");
+            }
+            shards.attachLog(nullptr);
+        }
+        logSize = std::filesystem::file_size(logPath);
+
+        auto start = std::chrono::steady_clock::now();
+        saveSnapshot(snapshotPath, shards, channels, logSize);
+        printValue("write snapshot", secondsSince(start), "s");
+
+        // Password changes of existing users while a background snapshot is written: every
+        // change touches a chunk the snapshot still shares, the worst case for extra memory
+        auto changePasswords = [&](std::size_t first, std::size_t count) {
+            auto changeStart = std::chrono::steady_clock::now();
+            for (std::size_t i = first; i < first + count; ++i) {
+                std::string name = "client" + std::to_string(i % userCount);
+                shards.shardForName(name).setPasswordOfName(name, "changed1");
+            }
+            return count / secondsSince(changeStart);
+        };
+        const std::size_t changeCount = 1000000;
+        printValue("password changes/s, no snapshot", changePasswords(0, changeCount), "");
+
+        SnapshotThread snapshots(snapshotPath + ".bg", shards, channels, nullptr, std::chrono::seconds(0), stats);
+        std::uint64_t copiedBefore = CowStats::copiedBytes.load();
+        double snapshotSeconds = 0.0;
+        std::thread background([&] {
+            auto snapshotStart = std::chrono::steady_clock::now();
+            snapshots.take();
+            snapshotSeconds = secondsSince(snapshotStart);
+        });
+        printValue("password changes/s, during a snapshot", changePasswords(changeCount, changeCount), "");
+        background.join();
+        printValue("background snapshot", snapshotSeconds, "s");
+        printValue("  memory copied for it", (CowStats::copiedBytes.load() - copiedBefore) / 1048576.0, "MB");
+        std::remove((snapshotPath + ".bg").c_str());
+    }
+    printValue("log size", logSize / 1048576.0, "MB");
+    printValue("snapshot size", std::filesystem::file_size(snapshotPath) / 1048576.0, "MB");
+
+    {
+        ChannelRegistry channels;
+        UserShards shards(1, channels);
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t offset = 0;
+        shards.replay(logPath, offset);
+        printValue("start from the log only", secondsSince(start), "s");
+    }
+    {
+        ChannelRegistry channels;
+        UserShards shards(1, channels);
+        auto start = std::chrono::steady_clock::now();
+        SnapshotInfo info;
+        loadSnapshot(snapshotPath, shards, channels, info);
+        std::uint64_t offset = info.logOffset;
+        shards.replay(logPath, offset);
+        printValue("start from the snapshot (+ empty log tail)", secondsSince(start), "s");
+    }
+
+    std::remove(logPath.c_str());
+    std::remove(snapshotPath.c_str());
+}
+
+#endif // SNAPSHOTBENCH_H
@@ -0,0 +1,76 @@
+#ifndef TIMERWHEELBENCH_H
+#define TIMERWHEELBENCH_H
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "timerwheel.h"
+#include "benchutil.h"
+
+// Session timers at 10K, 1M and 4M sessions: the cost of re-arming a random session (one
+// heartbeat) in the timer wheel against an ordered set of (deadline, session), and the cost
+// per session of expiring all of them. Ticks are 100 ms like in UserManager, the timeout is a minute.
+inline void runTimerWheelBench() {
+    const std::uint64_t timeout = 600;
+    for (std::size_t sessions : {std::size_t(10000), std::size_t(1000000), std::size_t(4000000)}) {
+        printHeader("session timers, " + std::to_string(sessions) + " sessions");
+        std::mt19937_64 random(42);
+        std::vector<std::uint32_t> order(1 << 20);
+        for (std::uint32_t& session : order) session = static_cast<std::uint32_t>(random() % sessions);
+
+        {
+            TimerWheel<std::uint32_t> wheel(0);
+            std::vector<TimerWheel<std::uint32_t>::Timer> timers(sessions);
+            for (std::size_t i = 0; i < sessions; ++i) {
+                timers[i] = wheel.add(random() % timeout, static_cast<std::uint32_t>(i));
+            }
+            std::uint64_t now = 0;
+            std::size_t next = 0;
+            printResult("wheel, re-arm", nanosPerOp(1000000, [&] {
+                std::uint32_t session = order[next++ & (order.size() - 1)];
+                if ((next & 1023) == 0) wheel.advance(++now);
+                wheel.rearm(timers[session], now + timeout);
+            }));
+
+            std::uint32_t expired = 0;
+            std::size_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            wheel.advance(now + 2 * timeout);
+            while (wheel.popExpired(expired)) ++count;
+            double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            doNotOptimize(expired);
+            printResult("wheel, expire all", nanos / static_cast<double>(count));
+        }
+        {
+            std::set<std::pair<std::uint64_t, std::uint32_t>> timers;
+            std::vector<std::uint64_t> deadlines(sessions);
+            for (std::size_t i = 0; i < sessions; ++i) {
+                deadlines[i] = random() % timeout;
+                timers.emplace(deadlines[i], static_cast<std::uint32_t>(i));
+            }
+            std::uint64_t now = 0;
+            std::size_t next = 0;
+            printResult("std::set, re-arm", nanosPerOp(1000000, [&] {
+                std::uint32_t session = order[next++ & (order.size() - 1)];
+                if ((next & 1023) == 0) ++now;
+                timers.erase({deadlines[session], session});
+                deadlines[session] = now + timeout;
+                timers.emplace(deadlines[session], session);
+            }));
+
+            std::size_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            while (!timers.empty() && timers.begin()->first <= now + 2 * timeout) {
+                timers.erase(timers.begin());
+                ++count;
+            }
+            double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            printResult("std::set, expire all", nanos / static_cast<double>(count));
+        }
+    }
+}
+
+#endif // TIMERWHEELBENCH_H
@@ -0,0 +1,122 @@
+#ifndef USERTABLEBENCH_H
+#define USERTABLEBENCH_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "usertable.h"
+#include "allocationcounter.h"
+#include "benchutil.h"
+
+// The user storage before UserTable: four string maps plus the name index
+struct LegacyUserTables {
+    struct Registration {
+        std::string channel;
+        std::string generatedUsername;
+    };
+
+    std::unordered_map<std::string, std::string> registeredUsers; // key = name|channel, value = generatedUsername
+    std::unordered_map<std::string, std::string> passwords;       // key = generatedUsername, value = password
+    std::unordered_map<std::string, bool> loggedInUsers;          // key = generatedUsername
+    std::unordered_map<std::string, std::string> userChannels;    // key = generatedUsername, value = channel
+    std::unordered_map<std::string, std::vector<Registration>> registrationsByName; // key = name
+
+    void registerUser(const std::string& name, const std::string& channel, const std::string& username) {
+        registeredUsers[name + "|" + channel] = username;
+        userChannels[username] = channel;
+        registrationsByName[name].push_back(Registration{channel, username});
+    }
+
+    // The login path: name -> generated username -> password
+    bool verifyLogin(const std::string& name, const std::string& password) const {
+        auto it = registrationsByName.find(name);
+        if (it == registrationsByName.end() || it->second.empty()) return false;
+        auto pw = passwords.find(it->second.back().generatedUsername);
+        return pw != passwords.end() && pw->second == password;
+    }
+};
+
+// Synthetic users: name, channel (100 channels), generated username and a 12 character password
+struct BenchUsers {
+    std::vector<std::string> names;
+    std::vector<std::string> channels;
+    std::vector<std::string> generated;
+    std::vector<std::string> passwords;
+    std::vector<std::size_t> lookupOrder; // random permutation of the users
+
+    explicit BenchUsers(std::size_t count) {
+        static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+        std::mt19937_64 random(42);
+        names.reserve(count);
+        channels.reserve(count);
+        generated.reserve(count);
+        passwords.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            names.push_back("client" + std::to_string(i));
+            channels.push_back("channel" + std::to_string(i % 100));
+            std::string username = "User_";
+            for (int c = 0; c < 8; ++c) username += chars[random() % 62];
+            generated.push_back(username);
+            std::string password;
+            for (int c = 0; c < 12; ++c) password += chars[random() % 62];
+            passwords.push_back(password);
+            lookupOrder.push_back(i);
+        }
+        std::shuffle(lookupOrder.begin(), lookupOrder.end(), random);
+    }
+};
+
+inline void runUserTableBench() {
+    const std::size_t userCount = 1000000;
+    printHeader("user storage, " + std::to_string(userCount) + " users");
+    BenchUsers users(userCount);
+
+    {
+        std::size_t bytesBefore = heapBytesInUse();
+        std::size_t allocationsBefore = heapAllocationsInUse();
+        LegacyUserTables legacy;
+        for (std::size_t i = 0; i < userCount; ++i) {
+            legacy.registerUser(users.names[i], users.channels[i], users.generated[i]);
+            legacy.passwords[users.generated[i]] = users.passwords[i];
+            legacy.loggedInUsers[users.generated[i]] = true;
+        }
+        std::cout << " string maps (before UserTable)" << std::endl;
+        printValue("bytes per user", double(heapBytesInUse() - bytesBefore) / userCount, "B");
+        printValue("allocations per user", double(heapAllocationsInUse() - allocationsBefore) / userCount, "");
+
+        std::size_t next = 0;
+        printResult("login lookup (name -> password check)", nanosPerOp(userCount, [&] {
+            std::size_t i = users.lookupOrder[next++ % userCount];
+            doNotOptimize(legacy.verifyLogin(users.names[i], users.passwords[i]));
+        }));
+    }
+
+    {
+        std::size_t bytesBefore = heapBytesInUse();
+        std::size_t allocationsBefore = heapAllocationsInUse();
+        ChannelRegistry channels;
+        UserTable table;
+        for (std::size_t i = 0; i < userCount; ++i) {
+            GeneratedName generated;
+            GeneratedName::parse(users.generated[i], generated);
+            UserId id = table.add(users.names[i], channels.intern(users.channels[i]), generated);
+            table.setPassword(id, users.passwords[i]);
+            table.setLoggedIn(id, true);
+        }
+        std::cout << " UserTable" << std::endl;
+        printValue("bytes per user", double(heapBytesInUse() - bytesBefore) / userCount, "B");
+        printValue("allocations per user", double(heapAllocationsInUse() - allocationsBefore) / userCount, "");
+
+        std::size_t next = 0;
+        printResult("login lookup (name -> password check)", nanosPerOp(userCount, [&] {
+            std::size_t i = users.lookupOrder[next++ % userCount];
+            UserId id = table.find(users.names[i]);
+            doNotOptimize(id != noUser && table.verifyPassword(id, users.passwords[i]));
+        }));
+    }
+}
+
+#endif // USERTABLEBENCH_H
@@ -0,0 +1,79 @@
+#ifndef WALBENCH_H
+#define WALBENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "usermanager.h"
+#include "writeaheadlog.h"
+#include "benchutil.h"
+
+// One handle thread registers users (registerUser + setPasswordOfName, like a client
+// joining) as fast as it can, without a log and with each durability mode of the
+// write-ahead log. Two times per mode: the registrations alone, which is what the handle
+// thread sees since it never waits for the log writer, and until the writer has written
+// every record as well (and synced it, with --wal-sync batch).
+inline void runWalBench() {
+    const std::size_t userCount = 200000;
+    const std::string path = "zmq_bench.wal";
+    printHeader("write-ahead log, " + std::to_string(userCount) + " registrations");
+
+    std::vector<std::string> names;
+    names.reserve(userCount);
+    for (std::size_t i = 0; i < userCount; ++i) names.push_back("client" + std::to_string(i));
+
+    struct Mode {
+        const char* label;
+        bool logged;
+        SyncMode sync;
+        std::chrono::milliseconds interval;
+    };
+    const Mode modes[] = {
+        { "in memory only", false, SyncMode::off, std::chrono::milliseconds(0) },
+        { "log, --wal-sync off", true, SyncMode::off, std::chrono::milliseconds(0) },
+        { "log, --wal-sync 100 (ms)", true, SyncMode::interval, std::chrono::milliseconds(100) },
+        { "log, --wal-sync batch", true, SyncMode::batch, std::chrono::milliseconds(0) },
+    };
+
+    double inMemory = 0.0;
+    for (const Mode& mode : modes) {
+        double best = 0.0;
+        double bestWritten = 0.0;
+        for (int round = 0; round < 3; ++round) {
+            std::remove(path.c_str());
+            ServerStats stats;
+            ChannelRegistry channels;
+            UserManager users(channels);
+            std::unique_ptr<WriteAheadLog> log;
+            if (mode.logged) {
+                log = std::make_unique<WriteAheadLog>(path, mode.sync, mode.interval, stats);
+                users.attachLog(log.get());
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < userCount; ++i) {
+                users.registerUser(names[i], "bench", GeneratedName(i));
+                users.setPasswordOfName(names[i], "secret12");
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (round == 0 || seconds < best) best = seconds;
+            if (log != nullptr) log->waitUntilWritten(log->position());
+            double written = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (round == 0 || written < bestWritten) bestWritten = written;
+
+            // Drains and closes the log before the next round starts
+            log.reset();
+        }
+        if (!mode.logged) inMemory = best;
+        printValue(std::string(mode.label) + ", registrations/s", userCount / best, "");
+        if (!mode.logged) continue;
+        printValue("  slower than in memory", (best / inMemory - 1.0) * 100.0, "%");
+        printValue("  registrations/s until written", userCount / bestWritten, "");
+        printValue("  slower than in memory, until written", (bestWritten / inMemory - 1.0) * 100.0, "%");
+    }
+    std::remove(path.c_str());
+}
+
+#endif // WALBENCH_H
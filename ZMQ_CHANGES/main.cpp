@@ -0,0 +1,112 @@
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <zmq.hpp>
+#include <benthernet/changes.hpp>
+
+using namespace benthernet;
+
+// Follows the change events of a server started with --changes and prints them, e.g.
+//   ZMQ_CHANGES --endpoint tcp://localhost:24044 --cursor changes.cursor
+// The stream and next of the last batch are its cursor. When the server does not answer a
+// fetch in time it connects again and fetches from the cursor, so no event is printed twice
+// or skipped; with --cursor the cursor is kept in a file and a restart resumes there too.
+
+struct Cursor {
+    std::uint64_t stream = 0; // 0 = no batch seen yet
+    std::uint64_t next = 0;
+};
+
+static Cursor loadCursor(const std::string& path) {
+    Cursor cursor;
+    std::ifstream in(path);
+    if (!(in >> cursor.stream >> cursor.next)) return Cursor{};
+    return cursor;
+}
+
+static void saveCursor(const std::string& path, const Cursor& cursor) {
+    std::ofstream out(path, std::ios::trunc);
+    out << cursor.stream << " " << cursor.next << std::endl;
+}
+
+static const char* kindName(ChangeEvent::Kind kind) {
+    switch (kind) {
+    case ChangeEvent::registered: return "geregistreerd";
+    case ChangeEvent::passwordSet: return "wachtwoord";
+    case ChangeEvent::login: return "ingelogd";
+    case ChangeEvent::logout: return "uitgelogd";
+    case ChangeEvent::chatPosted: return "chat";
+    }
+    return "onbekend";
+}
+
+int main(int argc, char* argv[]) {
+    std::string endpoint = "tcp://localhost:24044";
+    std::string cursorPath;
+    std::uint32_t maxEvents = 1000;
+    int replyTimeout = 3000; // ms; the server answers a fetch within about a second, also without events
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--endpoint" && i + 1 < argc) {
+            endpoint = argv[++i];
+        } else if (arg == "--cursor" && i + 1 < argc) {
+            cursorPath = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            long long events = std::atoll(argv[++i]);
+            maxEvents = events > 0 ? static_cast<std::uint32_t>(events) : 1;
+        } else {
+            std::cerr << "[Changes] Onbekende optie genegeerd: " << arg << std::endl;
+        }
+    }
+
+    Cursor cursor = cursorPath.empty() ? Cursor{} : loadCursor(cursorPath);
+    zmq::context_t context;
+    while (true) {
+        zmq::socket_t socket{context, zmq::socket_type::dealer};
+        socket.setsockopt(ZMQ_LINGER, 0);
+        socket.setsockopt(ZMQ_RCVTIMEO, replyTimeout);
+        socket.connect(endpoint.c_str());
+        std::cout << "[Changes] Verbonden met " << endpoint << ", vanaf event " << cursor.next << std::endl;
+
+        while (true) {
+            std::string fetch = changeformat::encodeFetch(cursor.next, maxEvents);
+            socket.send(fetch.data(), fetch.size(), 0);
+            zmq::message_t batch;
+            if (!socket.recv(&batch, 0)) break;
+            const char* data = static_cast<const char*>(batch.data());
+            if (batch.size() < changeformat::batchHeaderSize || data[0] != changeformat::batchMessage) continue;
+            std::uint64_t stream = changeformat::getInt(data + 1, 8);
+            std::uint64_t oldest = changeformat::getInt(data + 9, 8);
+            std::uint64_t next = changeformat::getInt(data + 17, 8);
+
+            // Another stream numbers its events anew: the cursor says nothing about it
+            if (cursor.stream != 0 && stream != cursor.stream) {
+                std::cout << "[Changes] Server is herstart, opnieuw vanaf het begin" << std::endl;
+                cursor = Cursor{stream, 0};
+                continue;
+            }
+            cursor.stream = stream;
+            if (cursor.next != 0 && cursor.next < oldest) {
+                std::cout << "[Changes] Events " << cursor.next << " tot " << oldest
+                          << " gemist, ze zijn niet meer in de backlog" << std::endl;
+            }
+
+            std::size_t pos = changeformat::batchHeaderSize;
+            ChangeEvent event;
+            while (std::size_t size = changeformat::decode(data + pos, batch.size() - pos, event)) {
+                std::cout << event.sequence << " " << kindName(event.kind) << " " << event.name << "|" << event.channel;
+                if (!event.value.empty()) std::cout << " " << event.value;
+                std::cout << std::endl;
+                pos += size;
+            }
+            if (next != cursor.next) {
+                cursor.next = next;
+                if (!cursorPath.empty()) saveCursor(cursorPath, cursor);
+            }
+        }
+        // No answer: the server is gone or the connection broke; a new socket asks again
+        std::cerr << "[Changes] Geen antwoord van " << endpoint << ", opnieuw verbinden" << std::endl;
+    }
+}
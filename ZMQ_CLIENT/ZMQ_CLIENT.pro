@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++17
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -9,3 +9,9 @@ LIBS += -L$$PWD/../lib -lws2_32 -lpthread -lIphlpapi -lzmq
 INCLUDEPATH += $$PWD/../include
 
 SOURCES += main.cpp
+
+HEADERS += \
+    ../include/benthernet/codec.hpp \
+    ../include/benthernet/delimscan.hpp \
+    ../include/benthernet/messages.hpp \
+    ../include/benthernet/schema.hpp
@@ -5,10 +5,18 @@
 #include <chrono>
 #include <thread>
 #include <atomic> // For std::atomic_bool to control the chat thread
+#include <benthernet/codec.hpp>
+
+using namespace benthernet;
 
 // Helper function to check if a message starts with a specific topic
-bool startsWith(const std::string& fullString, const std::string& prefix) {
-    return fullString.rfind(prefix, 0) == 0;
+bool startsWith(std::string_view fullString, std::string_view prefix) {
+    return fullString.substr(0, prefix.size()) == prefix;
+}
+
+// Helper function to subscribe a SUB socket to the topic of a message schema
+void subscribe(zmq::socket_t& socket, std::string_view topic) {
+    socket.setsockopt(ZMQ_SUBSCRIBE, topic.data(), topic.size());
 }
 
 // Global atomic boolean to signal the chat listener thread to stop
@@ -18,6 +26,16 @@ std::atomic_bool stopChatListener(false);
 // This thread will now use its own dedicated SUB socket.
 void chatListenerThread(zmq::socket_t& chatSubSocket, const std::string& currentChannel, const std::string& userName);
 
+// Global atomic boolean to signal the heartbeat thread to stop
+std::atomic_bool stopHeartbeat(false);
+
+// Seconds between heartbeats, well below the session timeout of the server (60 by default)
+const int heartbeatIntervalSeconds = 10;
+
+// Keeps the session alive while logged in. Runs on its own thread with its own sockets,
+// because ZMQ sockets may not be shared between threads.
+void heartbeatThread(zmq::context_t& context, const std::string& userName);
+
 class ZMQClient {
 private:
     zmq::context_t context;
@@ -47,12 +65,12 @@ public:
         chatSubSocket.connect("tcp://localhost:24042");    // Or "tcp://benternet.pxl-ea-ict.be:24042"
 
         // Subscribe serviceSubSocket to all relevant service topics
-        serviceSubSocket.setsockopt(ZMQ_SUBSCRIBE, "service>username!>", 17);
-        serviceSubSocket.setsockopt(ZMQ_SUBSCRIBE, "service>password!>", 17);
-        serviceSubSocket.setsockopt(ZMQ_SUBSCRIBE, "service>login!>", 14);
-        serviceSubSocket.setsockopt(ZMQ_SUBSCRIBE, "service>game!>", 12);
-        serviceSubSocket.setsockopt(ZMQ_SUBSCRIBE, "service>clients!>", 16);
-        serviceSubSocket.setsockopt(ZMQ_SUBSCRIBE, "service>logout!>", 15);
+        subscribe(serviceSubSocket, UsernameReply::topic);
+        subscribe(serviceSubSocket, PasswordReply::topic);
+        subscribe(serviceSubSocket, LoginReply::topic);
+        subscribe(serviceSubSocket, GameReply::topic);
+        subscribe(serviceSubSocket, ClientsReply::topic);
+        subscribe(serviceSubSocket, LogoutReply::topic);
 
         // Set a default timeout for the serviceSubSocket
         serviceSubSocket.setsockopt(ZMQ_RCVTIMEO, 2000); // 2000 ms = 2 seconds timeout for service receives
@@ -62,18 +80,18 @@ public:
         pushSocket.send(msg.c_str(), msg.size(), 0);
     }
 
-    // This method now exclusively uses serviceSubSocket
-    std::string receiveSpecificMessage(const std::string& expectedTopicPrefix, int timeoutMs = 5000) {
+    // This method now exclusively uses serviceSubSocket.
+    // The returned view points into reply, so it stays valid as long as reply does.
+    std::string_view receiveSpecificMessage(std::string_view expectedTopicPrefix, zmq::message_t& reply, int timeoutMs = 5000) {
         serviceSubSocket.setsockopt(ZMQ_RCVTIMEO, timeoutMs); // Temporarily set timeout
 
-        zmq::message_t reply;
-        std::string fullResponse;
+        std::string_view fullResponse;
 
         // This loop will retry receiving until it gets the expected message or times out.
         // It no longer needs to worry about discarding chat messages.
         while (true) {
             if (serviceSubSocket.recv(&reply, 0)) { // Blocking receive with timeout
-                fullResponse = std::string(static_cast<char*>(reply.data()), reply.size());
+                fullResponse = view(reply);
                 std::cout << "[Client Debug] Received (Service Socket): " << fullResponse << std::endl;
 
                 if (startsWith(fullResponse, expectedTopicPrefix)) {
@@ -94,22 +112,24 @@ public:
                     std::cerr << "[Client] ZMQ Receive Error on Service Socket: " << zmq_strerror(error) << std::endl;
                 }
                 serviceSubSocket.setsockopt(ZMQ_RCVTIMEO, 2000); // Reset timeout
-                return ""; // Return empty string on timeout or error
+                return {}; // Return empty view on timeout or error
             }
         }
     }
 
     void registerUser() {
-        std::string regMsg = "service>username?>" + userName + "|" + channel;
+        std::string regMsg = UsernameRequest::toString(userName, channel);
         std::cout << "[Client] Sending registration: " << regMsg << std::endl;
         sendMessage(regMsg);
-        std::string response = receiveSpecificMessage("service>username!>");
+        zmq::message_t reply;
+        std::string_view response = receiveSpecificMessage(UsernameReply::topic, reply);
         if (!response.empty()) {
             std::cout << "[Client] Final Response: " << response << std::endl;
-            size_t start = response.find("geregistreerd als: ") + strlen("geregistreerd als: ");
-            size_t end = response.find(">", start);
-            if (start != std::string::npos && end != std::string::npos) {
-                generatedUsername = response.substr(start, end - start);
+            UsernameReply::Fields fields;
+            UsernameReply::decode(response, fields);
+            std::string_view text = fields[UsernameReply::text];
+            if (startsWith(text, registeredAsText)) {
+                generatedUsername = std::string(text.substr(registeredAsText.size()));
                 std::cout << "[Client] Server assigned username: " << generatedUsername << std::endl;
             }
         } else {
@@ -125,16 +145,18 @@ public:
             std::cout << "Wachtwoord moet minimaal 10 tekens zijn. Lengte wordt op 10 gezet." << std::endl;
             length = 10;
         }
-        std::string passReq = "service>password?>" + userName + "|" + std::to_string(length);
+        std::string passReq = PasswordRequest::toString(userName, std::to_string(length));
         std::cout << "[Client] Sending password request: " << passReq << std::endl;
         sendMessage(passReq);
-        std::string response = receiveSpecificMessage("service>password!>");
+        zmq::message_t reply;
+        std::string_view response = receiveSpecificMessage(PasswordReply::topic, reply);
         if (!response.empty()) {
             std::cout << "[Client] Final Response: " << response << std::endl;
-            size_t pwPos = response.find("Je wachtwoord is: ");
-            if (pwPos != std::string::npos) {
-                password = response.substr(pwPos + 18);
-                if (!password.empty() && password.back() == '>') password.pop_back();
+            PasswordReply::Fields fields;
+            PasswordReply::decode(response, fields);
+            std::string_view text = fields[PasswordReply::text];
+            if (startsWith(text, passwordIsText)) {
+                password = std::string(text.substr(passwordIsText.size()));
             }
         } else {
             std::cout << "[Client] Failed to receive expected password response." << std::endl;
@@ -142,13 +164,16 @@ public:
     }
 
     bool login() {
-        std::string loginReq = "service>login?>" + userName + "|" + password;
+        std::string loginReq = LoginRequest::toString(userName, password);
         std::cout << "[Client] Sending login request: " << loginReq << std::endl;
         sendMessage(loginReq);
-        std::string response = receiveSpecificMessage("service>login!>");
+        zmq::message_t reply;
+        std::string_view response = receiveSpecificMessage(LoginReply::topic, reply);
         if (!response.empty()) {
             std::cout << "[Client] Final Response: " << response << std::endl;
-            bool success = response.find("Succesvol ingelogd") != std::string::npos;
+            LoginReply::Fields fields;
+            LoginReply::decode(response, fields);
+            bool success = fields[LoginReply::text] == loginSucceededText;
             if (success) {
                 // If login successful, we assume the server associated our userName with a generatedUsername.
                 // We *must* have generatedUsername from registration for chat to work.
@@ -163,10 +188,11 @@ public:
     }
 
     void logout() {
-        std::string logoutMsg = "service>logout?>" + userName;
+        std::string logoutMsg = LogoutRequest::toString(userName);
         std::cout << "[Client] Sending logout request: " << logoutMsg << std::endl;
         sendMessage(logoutMsg);
-        std::string response = receiveSpecificMessage("service>logout!>");
+        zmq::message_t reply;
+        std::string_view response = receiveSpecificMessage(LogoutReply::topic, reply);
         if (!response.empty()) {
             std::cout << "[Client] Final Response: " << response << std::endl;
             std::cout << "Uitgelogd." << std::endl;
@@ -178,16 +204,18 @@ public:
     }
 
     void requestRandomGame() {
-        std::string gameReq = "service>game?>" + userName + "|" + channel;
+        std::string gameReq = GameRequest::toString(concat(userName, '|', channel));
         std::cout << "[Client] Requesting random game: " << gameReq << std::endl;
         sendMessage(gameReq);
-        std::string response = receiveSpecificMessage("service>game!");
+        zmq::message_t reply;
+        std::string_view response = receiveSpecificMessage(GameReply::topic, reply);
         if (!response.empty()) {
             std::cout << "[Client] Final Response: " << response << std::endl;
-            size_t pos = response.find("Random game is: ");
-            if (pos != std::string::npos) {
-                std::string game = response.substr(pos + 16);
-                if (!game.empty() && game.back() == '>') game.pop_back();
+            GameReply::Fields fields;
+            GameReply::decode(response, fields);
+            std::string_view text = fields[GameReply::text];
+            if (startsWith(text, randomGameText)) {
+                std::string game(text.substr(randomGameText.size()));
                 std::cout << "Wil je deze game toevoegen aan je lijst om later te spelen? (j/n): ";
                 char keuze;
                 std::cin >> keuze;
@@ -213,17 +241,16 @@ public:
     }
 
     void requestClientList() {
-        std::string clientListReq = "service>clients?>";
+        std::string clientListReq = ClientsRequest::toString("");
         std::cout << "[Client] Requesting client list: " << clientListReq << std::endl;
         sendMessage(clientListReq);
-        std::string response = receiveSpecificMessage("service>clients!>");
+        zmq::message_t reply;
+        std::string_view response = receiveSpecificMessage(ClientsReply::topic, reply);
         if (!response.empty()) {
             std::cout << "[Client] Final Response: " << response << std::endl;
-            size_t pos = response.find(">");
-            if (pos != std::string::npos) {
-                std::string clientInfo = response.substr(pos + 1);
-                if (!clientInfo.empty() && clientInfo.back() == '>') clientInfo.pop_back();
-                std::cout << "Geregistreerde clients op de server: " << clientInfo << std::endl;
+            ClientsReply::Fields fields;
+            if (ClientsReply::decode(response, fields)) {
+                std::cout << "Geregistreerde clients op de server: " << fields[ClientsReply::text] << std::endl;
             }
         } else {
             std::cout << "[Client] Failed to receive expected client list response." << std::endl;
@@ -240,7 +267,7 @@ public:
         std::cout << "Type je bericht en druk op Enter. Type 'exit' om de chat te verlaten.\n";
 
         // Subscribe chatSubSocket to the specific channel for chat messages
-        std::string chatTopic = "chat!>" + channel + ">";
+        std::string chatTopic = std::string(ChatBroadcast::topic) + channel + ">";
         chatSubSocket.setsockopt(ZMQ_SUBSCRIBE, chatTopic.c_str(), chatTopic.length());
         std::cout << "[Client] Subscribed chatSubSocket to chat topic: " << chatTopic << std::endl;
 
@@ -260,7 +287,7 @@ public:
             }
 
             // Send chat message to server
-            std::string chatMsg = "chat>" + channel + ">" + generatedUsername + ">" + chatInput;
+            std::string chatMsg = ChatRequest::toString(channel, generatedUsername, chatInput);
             sendMessage(chatMsg);
         }
 
@@ -282,6 +309,9 @@ public:
         std::cin >> inputPw;
         password = inputPw;
         if (login()) {
+            stopHeartbeat.store(false);
+            std::thread heartbeat(heartbeatThread, std::ref(context), userName);
+
             bool loggedInMenu = true;
             while (loggedInMenu) {
                 std::cout << "\nJe bent ingelogd. Kies een optie:\n";
@@ -308,6 +338,11 @@ public:
                     std::cout << "Ongeldige keuze." << std::endl;
                 }
             }
+
+            stopHeartbeat.store(true);
+            if (heartbeat.joinable()) {
+                heartbeat.join();
+            }
             return true;
         } else {
             std::cout << "Inloggen mislukt. Probeer opnieuw." << std::endl;
@@ -369,17 +404,14 @@ void chatListenerThread(zmq::socket_t& chatSubSocket, const std::string& current
     while (!stopChatListener.load()) {
         zmq::message_t reply;
         if (chatSubSocket.recv(&reply, 0)) { // Blocking receive with timeout
-            std::string fullResponse = std::string(static_cast<char*>(reply.data()), reply.size());
+            std::string_view fullResponse = view(reply);
 
             // Parse the chat message: chat!>channel>sender_username>message_text
-            size_t firstSep = fullResponse.find(">"); // "chat!"
-            size_t secondSep = fullResponse.find(">", firstSep + 1); // channel
-            size_t thirdSep = fullResponse.find(">", secondSep + 1); // sender_username
-
-            if (firstSep != std::string::npos && secondSep != std::string::npos && thirdSep != std::string::npos) {
-                std::string receivedChannel = fullResponse.substr(firstSep + 1, secondSep - (firstSep + 1));
-                std::string senderUsername = fullResponse.substr(secondSep + 1, thirdSep - (secondSep + 1));
-                std::string chatMessageText = fullResponse.substr(thirdSep + 1);
+            ChatBroadcast::Fields fields;
+            if (ChatBroadcast::decode(fullResponse, fields) == ChatBroadcast::fieldCount) {
+                std::string_view receivedChannel = fields[ChatBroadcast::channel];
+                std::string_view senderUsername = fields[ChatBroadcast::sender];
+                std::string_view chatMessageText = fields[ChatBroadcast::text];
 
                 // Only display if it's for the current channel and not your own sent message
                 if (receivedChannel == currentChannel && senderUsername != currentGeneratedUsername) {
@@ -397,6 +429,35 @@ void chatListenerThread(zmq::socket_t& chatSubSocket, const std::string& current
     std::cout << "[Chat Listener] Thread stopped.\n";
 }
 
+// Sends service>heartbeat?> every heartbeatIntervalSeconds until stopHeartbeat is set.
+// The server only answers when the session is gone, e.g. after the client was suspended
+// for longer than the timeout; the user then has to log in again.
+void heartbeatThread(zmq::context_t& context, const std::string& userName) {
+    zmq::socket_t pushSocket(context, zmq::socket_type::push);
+    pushSocket.connect("tcp://localhost:24041");
+    zmq::socket_t replySocket(context, zmq::socket_type::sub);
+    replySocket.connect("tcp://localhost:24042");
+    std::string replyTopic = std::string(HeartbeatReply::topic) + userName + ">";
+    subscribe(replySocket, replyTopic);
+    replySocket.setsockopt(ZMQ_RCVTIMEO, 100); // Short timeout so the thread notices stopHeartbeat
+
+    std::string heartbeatMsg = HeartbeatRequest::toString(userName);
+    auto nextHeartbeat = std::chrono::steady_clock::now();
+    while (!stopHeartbeat.load()) {
+        if (std::chrono::steady_clock::now() >= nextHeartbeat) {
+            pushSocket.send(heartbeatMsg.c_str(), heartbeatMsg.size(), 0);
+            nextHeartbeat += std::chrono::seconds(heartbeatIntervalSeconds);
+        }
+        zmq::message_t reply;
+        if (replySocket.recv(&reply, 0)) {
+            HeartbeatReply::Fields fields;
+            HeartbeatReply::decode(view(reply), fields);
+            std::cout << "\n[Client] " << fields[HeartbeatReply::text] << ", log opnieuw in." << std::endl;
+            break;
+        }
+    }
+}
+
 
 int main() {
     std::string user, channel;
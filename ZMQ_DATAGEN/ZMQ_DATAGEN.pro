@@ -0,0 +1,14 @@
+TEMPLATE = app
+CONFIG += console c++17
+CONFIG -= app_bundle
+CONFIG -= qt
+
+DEFINES += ZMQ_STATIC
+
+LIBS += -L$$PWD/../lib -lws2_32 -lpthread -lIphlpapi -lzmq
+INCLUDEPATH += $$PWD/../include $$PWD/../ZMQ_SERVER
+
+SOURCES += main.cpp
+
+HEADERS += \
+    dataset.h
@@ -0,0 +1,134 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "channelregistry.h"
+#include "generatedname.h"
+#include "usermanager.h"
+#include "usernameallocator.h"
+#include "usertable.h"
+
+// What generateDataset makes: the clients "user0", "user1", ... each registered once, over
+// the channels "channel0", "channel1", ... round robin. Everything follows from seed, so the same spec
+// gives the same users, usernames and passwords again.
+struct DatasetSpec {
+    std::size_t users = 1000000;
+    std::size_t channels = 100;
+    int passwordLength = 10;  // 0 = no passwords
+    int loggedInPercent = 10; // share of the users with a password that are logged in
+    std::uint64_t seed = 1;
+};
+
+namespace datasetdetail {
+
+// splitmix64: one step per value, good enough for test data and cheap to seed per user
+inline std::uint64_t mix(std::uint64_t& state) {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Fills name with "user<index>" and returns it
+inline std::string_view clientName(std::size_t index, char (&name)[32]) {
+    std::memcpy(name, "user", 4);
+    char* end = std::to_chars(name + 4, name + sizeof(name), index).ptr;
+    return std::string_view(name, static_cast<std::size_t>(end - name));
+}
+
+// Key of the username allocator, from the seed
+inline UsernameAllocator::Key usernameKey(std::uint64_t seed) {
+    std::uint64_t state = seed;
+    return {mix(state), mix(state)};
+}
+
+} // namespace datasetdetail
+
+// The username allocator state of the dataset: user index has counter index, so the server that
+// loads the snapshot hands out the names after them
+inline UsernameAllocator::State datasetUsernames(const DatasetSpec& spec) {
+    return UsernameAllocator::State{datasetdetail::usernameKey(spec.seed), spec.users};
+}
+
+// The password of user index into password (sized to the password length), so a load test can
+// log the generated users in. Returns whether the user is logged in.
+inline bool datasetPassword(const DatasetSpec& spec, std::size_t index, std::string& password) {
+    static const std::string_view passwordChars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789!@#$%^&*";
+    password.resize(static_cast<std::size_t>(std::max(spec.passwordLength, 0)));
+    std::uint64_t state = spec.seed ^ (static_cast<std::uint64_t>(index) * 0xD1B54A32D192ED03ull);
+    for (char& c : password) c = passwordChars[datasetdetail::mix(state) % passwordChars.size()];
+    return static_cast<int>(datasetdetail::mix(state) % 100) < spec.loggedInPercent;
+}
+
+// Builds the users of spec as the rows of shardCount shards, spread by name like UserShards
+// does, ready for saveSnapshot. The rows go straight into the columns, each shard's sized up
+// front and filled on a thread of its own; the name index is left to the server, which builds
+// it once while it loads the snapshot. Neither registerUser (LeftRight applies each change
+// twice, the log, sessions) nor a lookup per new name is involved.
+inline std::vector<UserTable::Columns> generateDataset(const DatasetSpec& spec, std::size_t shardCount,
+                                                       ChannelRegistry& channels) {
+    using namespace datasetdetail;
+    std::vector<ChannelId> channelIds;
+    for (std::size_t i = 0; i < std::max<std::size_t>(spec.channels, 1); ++i) {
+        channelIds.push_back(channels.intern("channel" + std::to_string(i)));
+    }
+
+    // The shard of every user first, so each shard knows its size before it starts
+    std::vector<std::uint32_t> shardOf(spec.users);
+    std::size_t threadCount = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t] {
+            char name[32];
+            for (std::size_t i = t; i < spec.users; i += threadCount) {
+                shardOf[i] = static_cast<std::uint32_t>(shardOfName(clientName(i, name), shardCount));
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    threads.clear();
+    std::vector<std::size_t> rows(shardCount);
+    for (std::uint32_t shard : shardOf) ++rows[shard];
+
+    UsernameAllocator usernames(usernameKey(spec.seed));
+    std::vector<UserTable::Columns> tables(shardCount);
+    for (std::size_t shard = 0; shard < shardCount; ++shard) {
+        threads.emplace_back([&, shard] {
+            UserTable::Columns& table = tables[shard];
+            table.names.reserve(rows[shard]);
+            table.generatedUsernames.reserve(rows[shard]);
+            table.channels.reserve(rows[shard]);
+            table.passwords.reserve(rows[shard]);
+            table.flags.reserve(rows[shard]);
+            table.previousOfName.reserve(rows[shard]);
+            char name[32];
+            std::string password;
+            for (std::size_t i = 0; i < spec.users; ++i) {
+                if (shardOf[i] != shard) continue;
+                std::uint8_t flags = 0;
+                password.clear();
+                if (spec.passwordLength > 0) {
+                    flags = UserTable::hasPassword;
+                    if (datasetPassword(spec, i, password)) flags |= UserTable::loggedIn;
+                }
+                table.names.push_back(clientName(i, name));
+                table.generatedUsernames.push_back(usernames.nameOf(i));
+                table.channels.push_back(channelIds[i % channelIds.size()]);
+                table.passwords.push_back(password);
+                table.flags.push_back(flags);
+                table.previousOfName.push_back(noUser);
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    return tables;
+}
+
+#endif // DATASET_H
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "dataset.h"
+#include "snapshot.h"
+
+// Writes a snapshot with synthetic users for the server to load with --snapshot, e.g.
+//   ZMQ_DATAGEN --users 10000000 --channels 100 --shards 4 --out users.snap
+// Generate it for the --workers of the server: a snapshot with another shard count loads
+// too, but its users are spread over the shards again first.
+int main(int argc, char* argv[]) {
+    DatasetSpec spec;
+    std::size_t shardCount = 1;
+    std::string path = "users.snap";
+    std::size_t printUsers = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--users" && i + 1 < argc) {
+            long long users = std::atoll(argv[++i]);
+            spec.users = users > 0 ? static_cast<std::size_t>(users) : 0;
+        } else if (arg == "--channels" && i + 1 < argc) {
+            int channels = std::atoi(argv[++i]);
+            spec.channels = channels > 0 ? static_cast<std::size_t>(channels) : 1;
+        } else if (arg == "--password-length" && i + 1 < argc) {
+            int length = std::atoi(argv[++i]);
+            spec.passwordLength = length > 0 ? length : 0;
+        } else if (arg == "--logged-in" && i + 1 < argc) {
+            int percent = std::atoi(argv[++i]);
+            spec.loggedInPercent = std::min(std::max(percent, 0), 100);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            spec.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--shards" && i + 1 < argc) {
+            int shards = std::atoi(argv[++i]);
+            shardCount = shards > 0 ? static_cast<std::size_t>(shards) : 1;
+        } else if (arg == "--out" && i + 1 < argc) {
+            path = argv[++i];
+        } else if (arg == "--print" && i + 1 < argc) {
+            long long users = std::atoll(argv[++i]);
+            printUsers = users > 0 ? static_cast<std::size_t>(users) : 0;
+        } else {
+            std::cerr << "[Datagen] Onbekende optie genegeerd: " << arg << std::endl;
+        }
+    }
+
+    ChannelRegistry channels;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<UserTable::Columns> tables = generateDataset(spec, shardCount, channels);
+    double generateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    if (!saveSnapshot(path, tables, channels, datasetUsernames(spec), 0)) return 1;
+    double saveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[Datagen] " << spec.users << " gebruikers in " << spec.channels << " kanalen over " << shardCount
+              << " shards gemaakt in " << generateSeconds << "s, snapshot " << path << " geschreven in "
+              << saveSeconds << "s" << std::endl;
+
+    // A few users to log in with by hand
+    std::string password;
+    for (std::size_t i = 0; i < std::min(printUsers, spec.users); ++i) {
+        bool loggedIn = datasetPassword(spec, i, password);
+        std::cout << "user" << i << "|channel" << i % spec.channels << " " << password
+                  << (loggedIn ? " (ingelogd)" : "") << std::endl;
+    }
+    return 0;
+}
@@ -1,11 +1,44 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++17
 CONFIG -= app_bundle
 CONFIG -= qt
 
 DEFINES += ZMQ_STATIC
 
-LIBS += -L$$PWD/../lib -lws2_32 -lpthread -lIphlpapi -lzmq
+LIBS += -L$$PWD/../lib -lws2_32 -lpthread -lIphlpapi -lbcrypt -lzmq
 INCLUDEPATH += $$PWD/../include
 
 SOURCES += main.cpp
+
+HEADERS += \
+    ../include/benthernet/changes.hpp \
+    ../include/benthernet/codec.hpp \
+    ../include/benthernet/delimscan.hpp \
+    ../include/benthernet/messages.hpp \
+    ../include/benthernet/schema.hpp \
+    changefeed.h \
+    channelregistry.h \
+    coldstore.h \
+    cowcolumn.h \
+    dispatcher.h \
+    entropypool.h \
+    flathashmap.h \
+    generatedname.h \
+    leftright.h \
+    lsmstore.h \
+    mutation.h \
+    pipeline.h \
+    replication.h \
+    replypool.h \
+    requestarena.h \
+    requesthandler.h \
+    serverconfig.h \
+    serverstats.h \
+    snapshot.h \
+    spscring.h \
+    timerwheel.h \
+    usermanager.h \
+    usernameallocator.h \
+    usertable.h \
+    workerpool.h \
+    writeaheadlog.h
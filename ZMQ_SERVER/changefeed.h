@@ -0,0 +1,196 @@
+#ifndef CHANGEFEED_H
+#define CHANGEFEED_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+#include "serverstats.h"
+#include <benthernet/changes.hpp>
+
+using benthernet::ChangeEvent;
+
+// Serves the change events (format and fetch protocol in benthernet/changes.hpp) on a ROUTER
+// socket. The handle threads publish() every event into a ring of the last capacity events
+// under a short lock, so a consumer that was away can resume from its cursor as long as the
+// events are still in the ring. The feed thread answers the fetches; a fetch with nothing new
+// waits there until there is, checked every pollInterval, so the handle threads never signal it.
+class ChangeFeed {
+private:
+    static const std::uint32_t maxBatchEvents = 4096;
+    static const std::size_t maxBatchBytes = 1 << 20;
+    static constexpr std::chrono::milliseconds pollInterval{5};
+    static constexpr std::chrono::milliseconds longPoll{1000}; // longest a fetch waits for events
+
+    struct Fetch {
+        std::string identity;
+        std::uint64_t from;
+        std::uint32_t maxEvents;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    zmq::context_t& context;
+    std::string endpoint;
+    ServerStats& stats;
+    std::size_t statsSection;
+    const std::uint64_t stream; // start time of the server, so consumers notice a restart
+
+    std::mutex backlogMutex;
+    std::vector<std::string> backlog; // event with sequence s in slot s % size, the strings keep their capacity
+    std::uint64_t nextSequence = 1;
+    std::atomic<std::uint64_t> published{1}; // nextSequence, for the feed thread without the lock
+
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+    std::vector<Fetch> waiting; // only used by the feed thread
+
+    std::atomic<std::uint64_t> fetches{0};
+    std::atomic<std::uint64_t> eventsSent{0};
+    std::atomic<std::size_t> waitingCount{0};
+    std::uint64_t last[3] = {}; // counters at the previous report, only used by the reporter
+
+    static std::uint64_t wallClockMillis() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    std::uint64_t oldest() const {
+        return nextSequence > backlog.size() ? nextSequence - backlog.size() : 1;
+    }
+
+    void reply(zmq::socket_t& socket, const Fetch& fetch, std::string& batch) {
+        using namespace benthernet::changeformat;
+        batch.assign(batchHeaderSize, '\0');
+        batch[0] = batchMessage;
+        std::uint32_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(backlogMutex);
+            std::uint64_t sequence = std::min(std::max(fetch.from, oldest()), nextSequence);
+            std::uint32_t maxEvents = std::min(fetch.maxEvents, maxBatchEvents);
+            for (; sequence < nextSequence && count < maxEvents && batch.size() < maxBatchBytes; ++sequence, ++count) {
+                batch += backlog[sequence % backlog.size()];
+            }
+            putInt(putInt(putInt(&batch[1], stream, 8), oldest(), 8), sequence, 8);
+        }
+        socket.send(fetch.identity.data(), fetch.identity.size(), ZMQ_SNDMORE);
+        socket.send(batch.data(), batch.size(), 0);
+        eventsSent.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void receive(zmq::socket_t& socket, std::string& batch) {
+        using namespace benthernet::changeformat;
+        while (true) {
+            zmq::message_t identity, message;
+            if (!socket.recv(&identity, ZMQ_DONTWAIT)) return;
+            if (!identity.more() || !socket.recv(&message, 0)) continue;
+            while (message.more()) socket.recv(&message, 0);
+            const char* data = static_cast<const char*>(message.data());
+            if (message.size() < fetchSize || data[0] != fetchMessage) continue;
+
+            Fetch fetch{std::string(static_cast<const char*>(identity.data()), identity.size()),
+                        getInt(data + 1, 8), static_cast<std::uint32_t>(getInt(data + 9, 4)),
+                        std::chrono::steady_clock::now()};
+            fetches.fetch_add(1, std::memory_order_relaxed);
+            // A consumer has one fetch outstanding; a new one replaces what it asked before
+            waiting.erase(std::remove_if(waiting.begin(), waiting.end(), [&](const Fetch& other) {
+                return other.identity == fetch.identity;
+            }), waiting.end());
+            if (fetch.maxEvents == 0 || fetch.from < published.load()) {
+                reply(socket, fetch, batch);
+            } else {
+                waiting.push_back(std::move(fetch));
+            }
+        }
+    }
+
+    void run() {
+        zmq::socket_t socket{context, zmq::socket_type::router};
+        socket.setsockopt(ZMQ_LINGER, 0);
+        socket.bind(endpoint.c_str());
+        std::string batch;
+
+        while (!stopping.load()) {
+            zmq::pollitem_t items[] = {{ static_cast<void*>(socket), 0, ZMQ_POLLIN, 0 }};
+            zmq::poll(items, 1, pollInterval);
+            receive(socket, batch);
+
+            std::uint64_t next = published.load();
+            auto now = std::chrono::steady_clock::now();
+            waiting.erase(std::remove_if(waiting.begin(), waiting.end(), [&](const Fetch& fetch) {
+                if (fetch.from >= next && now - fetch.since < longPoll) return false;
+                reply(socket, fetch, batch);
+                return true;
+            }), waiting.end());
+            waitingCount.store(waiting.size(), std::memory_order_relaxed);
+        }
+    }
+
+    void printStats(std::ostream& out, double seconds) {
+        std::uint64_t now[3] = {published.load(), fetches.load(), eventsSent.load()};
+        std::uint64_t delta[3];
+        for (int i = 0; i < 3; ++i) {
+            delta[i] = now[i] - last[i];
+            last[i] = now[i];
+        }
+        std::uint64_t first;
+        {
+            std::lock_guard<std::mutex> lock(backlogMutex);
+            first = oldest();
+        }
+        out << "  [changes] " << std::fixed << std::setprecision(0)
+            << delta[0] / seconds << " events/s, backlog " << now[0] - first << " events (" << first << ".."
+            << now[0] - 1 << "), " << delta[1] / seconds << " fetches/s, " << delta[2] / seconds
+            << " events/s verstuurd, " << waitingCount.load() << " wachtende consumers" << std::endl;
+    }
+
+public:
+    // Keeps the last capacity events for consumers that resume
+    ChangeFeed(zmq::context_t& zmqContext, const std::string& bindEndpoint, std::size_t capacity, ServerStats& serverStats)
+        : context(zmqContext), endpoint(bindEndpoint), stats(serverStats), stream(wallClockMillis()),
+          backlog(std::max<std::size_t>(capacity, 1)) {
+        last[0] = 1;
+        statsSection = stats.addSection([this](std::ostream& out, double seconds) {
+            printStats(out, seconds);
+        });
+    }
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    ~ChangeFeed() {
+        stopping.store(true);
+        if (thread.joinable()) thread.join();
+        stats.removeSection(statsSection);
+    }
+
+    void start() {
+        thread = std::thread(&ChangeFeed::run, this);
+        std::cout << "[Changes] Events op " << endpoint << ", de laatste " << backlog.size() << " blijven bewaard" << std::endl;
+    }
+
+    // Gives the event the next sequence number; thread safe
+    void publish(ChangeEvent::Kind kind, std::string_view name, std::string_view channel, std::string_view value = {}) {
+        ChangeEvent event;
+        event.time = wallClockMillis();
+        event.kind = kind;
+        event.name = name;
+        event.channel = channel;
+        event.value = value;
+        std::lock_guard<std::mutex> lock(backlogMutex);
+        event.sequence = nextSequence;
+        std::string& slot = backlog[nextSequence % backlog.size()];
+        slot.clear();
+        benthernet::changeformat::encode(event, slot);
+        published.store(++nextSequence, std::memory_order_release);
+    }
+};
+
+#endif // CHANGEFEED_H
@@ -0,0 +1,65 @@
+#ifndef CHANNELREGISTRY_H
+#define CHANNELREGISTRY_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include "flathashmap.h"
+
+// Small integer id of an interned channel name
+using ChannelId = std::uint32_t;
+const ChannelId noChannel = 0xFFFFFFFFu;
+
+// Interns channel names for the whole server: every name is stored once and the user
+// records only carry its ChannelId. The text is looked up again when a message is written.
+// Shared by all UserManager shards. Channels are never removed, so an id and the view
+// returned by name() stay valid for the lifetime of the registry.
+class ChannelRegistry {
+private:
+    mutable std::shared_mutex registryMutex; // lookups share it, only a new channel takes it exclusively
+    std::deque<std::string> names;            // index = ChannelId; a deque never moves its elements
+    FlatHashMap<std::string_view, ChannelId> ids; // views into names
+
+public:
+    ChannelRegistry() = default;
+    ChannelRegistry(const ChannelRegistry&) = delete;
+    ChannelRegistry& operator=(const ChannelRegistry&) = delete;
+
+    // Id of the channel, registering it the first time
+    ChannelId intern(std::string_view channel) {
+        {
+            std::shared_lock<std::shared_mutex> lock(registryMutex);
+            const ChannelId* id = ids.find(channel);
+            if (id != nullptr) return *id;
+        }
+        std::unique_lock<std::shared_mutex> lock(registryMutex);
+        const ChannelId* known = ids.find(channel);
+        if (known != nullptr) return *known;
+        ChannelId id = static_cast<ChannelId>(names.size());
+        names.emplace_back(channel);
+        ids.tryEmplace(std::string_view(names.back()), id);
+        return id;
+    }
+
+    // Id of a known channel, or noChannel
+    ChannelId find(std::string_view channel) const {
+        std::shared_lock<std::shared_mutex> lock(registryMutex);
+        const ChannelId* id = ids.find(channel);
+        return id != nullptr ? *id : noChannel;
+    }
+
+    std::string_view name(ChannelId id) const {
+        std::shared_lock<std::shared_mutex> lock(registryMutex);
+        return names[id];
+    }
+
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(registryMutex);
+        return names.size();
+    }
+};
+
+#endif // CHANNELREGISTRY_H
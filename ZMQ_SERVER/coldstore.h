@@ -0,0 +1,124 @@
+#ifndef COLDSTORE_H
+#define COLDSTORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "generatedname.h"
+#include "mutation.h"
+
+// One registration of a client name that was moved out of memory
+struct ColdRegistration {
+    std::string channel; // by name: ChannelIds only hold within one run of the server
+    GeneratedName username;
+    bool hasPassword = false;
+    std::string password;
+};
+
+// Every registration of one client name, oldest first
+struct ColdUser {
+    std::string name;
+    std::vector<ColdRegistration> registrations;
+};
+
+// Stored form of the registrations of a ColdUser (the name is the key), little endian:
+//   u16 registration count
+//   | per registration: u16 channel size | channel | u64 packed username
+//                       | u8 has password | u16 password size | password
+namespace coldformat {
+
+// Whether user can be stored without cutting anything off: the name (a u16 sized key of the
+// store), the channels and passwords within mutationformat::maxTextSize, and at most 0xFFFF
+// registrations. UserManager keeps a user that does not fit in memory.
+inline bool fits(const ColdUser& user) {
+    if (user.name.size() > mutationformat::maxTextSize || user.registrations.size() > 0xFFFF) return false;
+    for (const ColdRegistration& registration : user.registrations) {
+        if (registration.channel.size() > mutationformat::maxTextSize
+            || registration.password.size() > mutationformat::maxTextSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void encode(const ColdUser& user, std::string& out) {
+    std::size_t size = 2;
+    for (const ColdRegistration& registration : user.registrations) {
+        size += 2 + mutationformat::textSize(registration.channel) + 8 + 1
+              + 2 + mutationformat::textSize(registration.password);
+    }
+    out.resize(size);
+    char* pos = mutationformat::putInt(&out[0], user.registrations.size(), 2);
+    for (const ColdRegistration& registration : user.registrations) {
+        pos = mutationformat::putText(pos, registration.channel);
+        pos = mutationformat::putInt(pos, registration.username.packed(), 8);
+        pos = mutationformat::putInt(pos, registration.hasPassword ? 1 : 0, 1);
+        pos = mutationformat::putText(pos, registration.password);
+    }
+}
+
+// Fills the registrations of user from data; false when data is not a complete value
+inline bool decode(std::string_view data, ColdUser& user) {
+    std::size_t pos = 0;
+    auto getInt = [&](std::size_t bytes, std::uint64_t& value) {
+        if (pos + bytes > data.size()) return false;
+        value = mutationformat::getInt(data.data() + pos, bytes);
+        pos += bytes;
+        return true;
+    };
+    auto getText = [&](std::string& text) {
+        std::uint64_t size;
+        if (!getInt(2, size) || pos + size > data.size()) return false;
+        text.assign(data.data() + pos, static_cast<std::size_t>(size));
+        pos += static_cast<std::size_t>(size);
+        return true;
+    };
+
+    std::uint64_t count;
+    if (!getInt(2, count)) return false;
+    user.registrations.resize(static_cast<std::size_t>(count));
+    for (ColdRegistration& registration : user.registrations) {
+        std::uint64_t username, hasPassword;
+        if (!getText(registration.channel) || !getInt(8, username) || !getInt(1, hasPassword)
+            || !getText(registration.password)) {
+            return false;
+        }
+        registration.username = GeneratedName(username);
+        registration.hasPassword = hasPassword != 0;
+    }
+    return pos == data.size();
+}
+
+} // namespace coldformat
+
+// Counters of the users kept in memory, updated by UserManager and printed by the store
+struct HotSetCounters {
+    std::atomic<std::uint64_t> hits{0};   // a request found its name in memory
+    std::atomic<std::uint64_t> loads{0};  // the name was brought back from the store
+    std::atomic<std::uint64_t> misses{0}; // the name was not registered at all
+    std::atomic<std::uint64_t> evictedNames{0};
+    std::atomic<std::uint64_t> evictedRows{0};
+};
+
+// Where UserManager moves the client names it has not seen for the longest time, so the
+// tables in memory grow with the active users instead of with every registration ever made
+// (see UserManager::evictIfFull). Implementations must allow get() from any thread and
+// put() from several shards at once.
+class ColdStore {
+public:
+    HotSetCounters counters;
+
+    virtual ~ColdStore() = default;
+
+    // Stores users, replacing the versions stored before. Returns true only once they are
+    // durable: the caller drops them from memory when it does. False as well, storing nothing,
+    // when one of them does not fit (see coldformat::fits).
+    virtual bool put(std::vector<ColdUser>& users) = 0;
+
+    // The most recently stored registrations of name; false when name was never stored
+    virtual bool get(std::string_view name, ColdUser& user) = 0;
+};
+
+#endif // COLDSTORE_H
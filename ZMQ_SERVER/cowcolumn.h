@@ -0,0 +1,307 @@
+#ifndef COWCOLUMN_H
+#define COWCOLUMN_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Columns of UserTable, stored in chunks of cowChunkRows rows held by shared_ptr.
+// Copying a column only copies the chunk pointers, so a frozen copy of a whole table (for
+// a snapshot) takes microseconds. The live column copies a chunk the first time it changes
+// it while a frozen copy still shares it; the frozen copy keeps seeing the old rows.
+const std::size_t cowChunkRows = 4096;
+
+// Bytes copied because a chunk was still shared with a frozen copy
+struct CowStats {
+    static inline std::atomic<std::uint64_t> copiedBytes{0};
+};
+
+template <typename Chunk>
+class CowChunks {
+private:
+    std::vector<std::shared_ptr<Chunk>> chunks;
+
+public:
+    std::size_t size() const {
+        return chunks.size();
+    }
+
+    const Chunk& operator[](std::size_t index) const {
+        return *chunks[index];
+    }
+
+    // The chunk, copied first when a frozen copy shares it
+    Chunk& writable(std::size_t index) {
+        std::shared_ptr<Chunk>& chunk = chunks[index];
+        if (chunk.use_count() > 1) {
+            chunk = std::make_shared<Chunk>(*chunk);
+            CowStats::copiedBytes.fetch_add(chunk->memoryUsage(), std::memory_order_relaxed);
+        } else {
+            // A frozen copy that shared the chunk may have just released it: its reads
+            // happened before that release and must not overlap the write that follows
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *chunk;
+    }
+
+    Chunk& append() {
+        chunks.push_back(std::make_shared<Chunk>());
+        return *chunks.back();
+    }
+
+    void reserve(std::size_t count) {
+        chunks.reserve(count);
+    }
+};
+
+inline std::size_t chunksFor(std::size_t rows) {
+    return (rows + cowChunkRows - 1) / cowChunkRows;
+}
+
+// Column of a trivially copyable type
+template <typename T>
+class CowColumn {
+private:
+    struct Chunk {
+        T rows[cowChunkRows];
+        std::size_t memoryUsage() const { return sizeof(Chunk); }
+    };
+
+    CowChunks<Chunk> chunks;
+    std::size_t count = 0;
+
+public:
+    std::size_t size() const {
+        return count;
+    }
+
+    const T& operator[](std::size_t row) const {
+        return chunks[row / cowChunkRows].rows[row % cowChunkRows];
+    }
+
+    // Reference for changing a row
+    T& write(std::size_t row) {
+        return chunks.writable(row / cowChunkRows).rows[row % cowChunkRows];
+    }
+
+    void push_back(const T& value) {
+        if (count % cowChunkRows == 0) chunks.append();
+        write(count++) = value;
+    }
+
+    void reserve(std::size_t rows) {
+        chunks.reserve(chunksFor(rows));
+    }
+
+    // Calls fn(const T* rows, std::size_t count) for the rows of each chunk, in order
+    template <typename Fn>
+    void forEachChunk(Fn&& fn) const {
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            fn(chunks[i].rows, std::min(cowChunkRows, count - i * cowChunkRows));
+        }
+    }
+
+    // Replaces the contents with rows rows, filled chunk by chunk by fn(T* rows, std::size_t count)
+    template <typename Fn>
+    void fill(std::size_t rows, Fn&& fn) {
+        *this = CowColumn();
+        chunks.reserve(chunksFor(rows));
+        for (std::size_t start = 0; start < rows; start += cowChunkRows) {
+            fn(chunks.append().rows, std::min(cowChunkRows, rows - start));
+        }
+        count = rows;
+    }
+};
+
+// Column of strings. Each chunk keeps the text of its rows back to back; a new value that
+// fits in the bytes a row had so far is written in place, a longer one is appended (the old
+// bytes stay unused). Once the unused bytes outgrow the used ones the chunk packs its text
+// again, and so does the copy a write makes of a chunk that a frozen copy shares.
+class TextColumn {
+private:
+    static const std::size_t minUnused = 64 * 1024; // unused bytes a chunk keeps without packing
+
+    struct Span {
+        std::uint32_t offset;
+        std::uint32_t length;
+        std::uint32_t capacity; // bytes at offset that belong to the row, at least length
+    };
+
+    struct Chunk {
+        Span spans[cowChunkRows];
+        std::string text;
+        std::size_t used = 0; // sum of the lengths
+
+        Chunk() = default;
+
+        // Takes only the bytes of the values, each row gets exactly its length
+        Chunk(const Chunk& other) : used(other.used) {
+            text.reserve(other.used);
+            for (std::size_t row = 0; row < cowChunkRows; ++row) {
+                const Span& span = other.spans[row];
+                spans[row] = Span{static_cast<std::uint32_t>(text.size()), span.length, span.length};
+                text.append(other.text, span.offset, span.length);
+            }
+        }
+
+        Chunk& operator=(const Chunk&) = delete;
+
+        std::size_t memoryUsage() const { return sizeof(Chunk) + text.capacity(); }
+
+        Span append(std::string_view value) {
+            Span span{static_cast<std::uint32_t>(text.size()), static_cast<std::uint32_t>(value.size()),
+                      static_cast<std::uint32_t>(value.size())};
+            text.append(value.data(), value.size());
+            used += value.size();
+            return span;
+        }
+
+        void assign(std::size_t row, std::string_view value) {
+            Span& span = spans[row];
+            if (value.size() <= span.capacity) {
+                value.copy(&text[span.offset], value.size());
+                used = used - span.length + value.size();
+                span.length = static_cast<std::uint32_t>(value.size());
+                return;
+            }
+            used -= span.length;
+            span = append(value);
+            if (text.size() - used > std::max(used, minUnused)) {
+                Chunk packed(*this);
+                std::copy(std::begin(packed.spans), std::end(packed.spans), std::begin(spans));
+                text.swap(packed.text);
+            }
+        }
+    };
+
+    CowChunks<Chunk> chunks;
+    std::size_t count = 0;
+
+public:
+    std::size_t size() const {
+        return count;
+    }
+
+    std::string_view operator[](std::size_t row) const {
+        const Chunk& chunk = chunks[row / cowChunkRows];
+        const Span& span = chunk.spans[row % cowChunkRows];
+        return std::string_view(chunk.text.data() + span.offset, span.length);
+    }
+
+    void push_back(std::string_view value) {
+        if (count % cowChunkRows == 0) chunks.append();
+        Chunk& chunk = chunks.writable(count / cowChunkRows);
+        chunk.spans[count % cowChunkRows] = chunk.append(value);
+        ++count;
+    }
+
+    void assign(std::size_t row, std::string_view value) {
+        chunks.writable(row / cowChunkRows).assign(row % cowChunkRows, value);
+    }
+
+    void reserve(std::size_t rows) {
+        chunks.reserve(chunksFor(rows));
+    }
+};
+
+// Column of client names. Names never change, so the text is only appended, into blocks
+// that never move: the views stay valid while the column or a frozen copy of it lives,
+// and the name index of UserTable keys on them.
+class NameColumn {
+private:
+    static constexpr std::size_t blockSize = 64 * 1024;
+
+    CowColumn<std::string_view> views;
+    std::vector<std::shared_ptr<char[]>> blocks;
+    std::size_t blockUsed = 0;
+    std::size_t blockCapacity = 0;
+
+public:
+    NameColumn() = default;
+
+    // A copy shares the blocks written so far but appends into a block of its own: the two
+    // LeftRight copies both append, and must not write into the free end of one block
+    NameColumn(const NameColumn& other) : views(other.views), blocks(other.blocks) {}
+
+    NameColumn& operator=(const NameColumn& other) {
+        views = other.views;
+        blocks = other.blocks;
+        blockUsed = 0;
+        blockCapacity = 0;
+        return *this;
+    }
+
+    NameColumn(NameColumn&&) = default;
+    NameColumn& operator=(NameColumn&&) = default;
+
+    std::size_t size() const {
+        return views.size();
+    }
+
+    std::string_view operator[](std::size_t row) const {
+        return views[row];
+    }
+
+    // Stores name as the next row and returns the stored view
+    std::string_view push_back(std::string_view name) {
+        if (name.size() > blockCapacity - blockUsed) {
+            blockCapacity = std::max(blockSize, name.size());
+            blocks.emplace_back(new char[blockCapacity]);
+            blockUsed = 0;
+        }
+        char* text = blocks.back().get() + blockUsed;
+        name.copy(text, name.size());
+        blockUsed += name.size();
+        std::string_view stored(text, name.size());
+        views.push_back(stored);
+        return stored;
+    }
+
+    // Next row with the name of an earlier row, without storing the text again
+    void push_back_stored(std::string_view stored) {
+        views.push_back(stored);
+    }
+
+    void reserve(std::size_t rows) {
+        views.reserve(rows);
+    }
+};
+
+// Snapshot form of a text column (see snapshot.h): the length of every row, then the
+// text of all rows back to back
+template <typename Writer, typename Column>
+void saveTextColumn(Writer& out, const Column& column) {
+    std::uint64_t total = 0;
+    for (std::size_t row = 0; row < column.size(); ++row) {
+        std::size_t length = column[row].size();
+        out.putInt(length, 4);
+        total += length;
+    }
+    out.putInt(total, 8);
+    for (std::size_t row = 0; row < column.size(); ++row) {
+        std::string_view value = column[row];
+        out.putBytes(value.data(), value.size());
+    }
+}
+
+// Reads what saveTextColumn wrote for rows rows, calling add(std::string_view) for each
+template <typename Reader, typename Fn>
+bool loadTextColumn(Reader& in, std::size_t rows, Fn&& add) {
+    std::vector<std::uint32_t> lengths(rows);
+    std::uint64_t total = 0;
+    for (std::uint32_t& length : lengths) {
+        length = static_cast<std::uint32_t>(in.getInt(4));
+        total += length;
+    }
+    if (in.getInt(8) != total || !in.ok() || total > in.remaining()) return false;
+    for (std::uint32_t length : lengths) add(in.getText(length));
+    return in.ok();
+}
+
+#endif // COWCOLUMN_H
@@ -0,0 +1,39 @@
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <functional>
+#include <benthernet/codec.hpp>
+
+// Callback that sends one reply to the clients, the message is moved into the socket
+using Publish = std::function<void(zmq::message_t&& reply)>;
+
+// Finds the handler of a message with one hash lookup on its topic.
+// The topic is the message up to its first '>', or up to the second '>' for
+// "service>" messages: "chat>", "service>login?>", ...
+// A new service only needs a registerHandler() call, no extra comparison per message.
+class Dispatcher {
+public:
+    using Handler = std::function<void(std::string_view message, const Publish& publish)>;
+
+private:
+    std::unordered_map<std::string_view, Handler> handlers; // key = topic, must outlive the dispatcher
+
+public:
+    // topic is normally a string literal, the table keeps a view on it
+    void registerHandler(std::string_view topic, Handler handler) {
+        handlers[topic] = std::move(handler);
+    }
+
+    // Returns false when no handler is registered for the topic of the message
+    bool dispatch(std::string_view message, const Publish& publish) const {
+        auto it = handlers.find(benthernet::topicOf(message));
+        if (it == handlers.end()) return false;
+        it->second(message, publish);
+        return true;
+    }
+};
+
+#endif // DISPATCHER_H
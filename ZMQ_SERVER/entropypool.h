@@ -0,0 +1,82 @@
+#ifndef ENTROPYPOOL_H
+#define ENTROPYPOOL_H
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <bcrypt.h>
+#elif defined(__linux__)
+#include <sys/random.h>
+#endif
+
+// Random bytes from the operating system (getrandom on Linux, BCryptGenRandom on Windows),
+// fetched a few KB at a time into a buffer of the calling thread, so a password costs about one
+// system call per few hundred passwords and the handle threads share no state. Where neither
+// is available, or the call fails, std::random_device fills the buffer instead.
+class EntropyPool {
+private:
+    static const std::size_t bufferSize = 4096;
+
+    std::array<std::uint8_t, bufferSize> buffer;
+    std::size_t used = bufferSize;
+
+    void refill() {
+        std::size_t filled = 0;
+#ifdef _WIN32
+        if (BCryptGenRandom(nullptr, buffer.data(), static_cast<ULONG>(buffer.size()),
+                            BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0) {
+            filled = buffer.size();
+        }
+#elif defined(__linux__)
+        while (filled < buffer.size()) {
+            ssize_t got = getrandom(buffer.data() + filled, buffer.size() - filled, 0);
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            filled += static_cast<std::size_t>(got);
+        }
+#endif
+        if (filled < buffer.size()) {
+            std::random_device device;
+            for (; filled < buffer.size(); ++filled) buffer[filled] = static_cast<std::uint8_t>(device());
+        }
+        used = 0;
+    }
+
+public:
+    EntropyPool() = default;
+    EntropyPool(const EntropyPool&) = delete;
+    EntropyPool& operator=(const EntropyPool&) = delete;
+
+    // The pool of the calling thread
+    static EntropyPool& local() {
+        thread_local EntropyPool pool;
+        return pool;
+    }
+
+    std::uint8_t byte() {
+        if (used == buffer.size()) refill();
+        return buffer[used++];
+    }
+
+    // Uniform in [0, bound) for bound 1..256. A byte of 256 - 256 % bound or more is drawn
+    // again, so every value comes from the same number of bytes and none is favoured.
+    std::size_t below(std::size_t bound) {
+        unsigned limit = 256u - 256u % static_cast<unsigned>(bound);
+        while (true) {
+            unsigned value = byte();
+            if (value < limit) return value % bound;
+        }
+    }
+};
+
+#endif // ENTROPYPOOL_H
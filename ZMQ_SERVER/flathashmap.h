@@ -0,0 +1,335 @@
+#ifndef FLATHASHMAP_H
+#define FLATHASHMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLATHASHMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Hash for FlatHashMap. std::hash of an integer is the integer itself on most standard
+// libraries, so the result is mixed: the map takes its probe position from the high bits
+// and a 7-bit tag from the low bits, and both must depend on the whole key.
+template <typename Key>
+struct FlatHash {
+    std::size_t operator()(const Key& key) const {
+        std::uint64_t x = static_cast<std::uint64_t>(std::hash<Key>{}(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(x ^ (x >> 32));
+    }
+};
+
+// Strings hash as string_view, so a std::string map can be searched with a string_view
+template <>
+struct FlatHash<std::string> {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view key) const {
+        std::uint64_t x = static_cast<std::uint64_t>(std::hash<std::string_view>{}(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(x ^ (x >> 32));
+    }
+};
+
+template <>
+struct FlatHash<std::string_view> : FlatHash<std::string> {};
+
+// Open-addressing hash map with all slots in one array (the SwissTable layout).
+// Next to the slots is one control byte per slot: empty, deleted, or the low 7 bits of the
+// hash of the key stored there. A lookup reads the 16 control bytes of a group at once and
+// compares them to the tag of the key with SSE2, so it only touches the slots whose tag
+// matches; the first group with an empty byte ends the search. Groups are probed
+// quadratically. The table grows at 7/8 full.
+//
+// Keys may be looked up by any type the Hash and KeyEqual accept (std::string keys by
+// string_view). Pointers returned by find()/tryEmplace() are invalidated by an insert that grows the table.
+template <typename Key, typename Value, typename Hash = FlatHash<Key>, typename KeyEqual = std::equal_to<>>
+class FlatHashMap {
+private:
+    struct Slot {
+        Key key;
+        Value value;
+    };
+
+    static const std::size_t groupSize = 16;
+    static const std::int8_t emptySlot = -128;  // 0b10000000
+    static const std::int8_t deletedSlot = -2;  // 0b11111110, full slots are 0..127
+
+    std::int8_t* control = nullptr;
+    Slot* slots = nullptr;
+    std::size_t capacity = 0; // slots, a power of two and a multiple of groupSize (or 0)
+    std::size_t count = 0;
+    std::size_t tombstones = 0;
+    Hash hasher;
+    KeyEqual equal;
+
+    // Bit i set when control byte i of the group equals value
+    static std::uint32_t matchByte(const std::int8_t* group, std::int8_t value) {
+#ifdef FLATHASHMAP_SSE2
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(value))));
+#else
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < groupSize; ++i) {
+            if (group[i] == value) mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+
+    // Bit i set when control byte i is empty or deleted (the sign bit is set only for those)
+    static std::uint32_t matchFree(const std::int8_t* group) {
+#ifdef FLATHASHMAP_SSE2
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < groupSize; ++i) {
+            if (group[i] < 0) mask |= 1u << i;
+        }
+        return mask;
+#endif
+    }
+
+    static unsigned lowestBit(std::uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+        unsigned bit = 0;
+        while ((mask & 1u) == 0) { mask >>= 1; ++bit; }
+        return bit;
+#endif
+    }
+
+    static std::int8_t tagOf(std::size_t hash) {
+        return static_cast<std::int8_t>(hash & 0x7F);
+    }
+
+    std::size_t firstGroup(std::size_t hash) const {
+        return (hash >> 7) & (capacity / groupSize - 1);
+    }
+
+    template <typename K>
+    std::size_t findIndex(const K& key, std::size_t hash) const {
+        if (capacity == 0) return capacity;
+        std::int8_t tag = tagOf(hash);
+        std::size_t groupMask = capacity / groupSize - 1;
+        std::size_t group = firstGroup(hash);
+        for (std::size_t step = 1; ; ++step) {
+            const std::int8_t* bytes = control + group * groupSize;
+            for (std::uint32_t mask = matchByte(bytes, tag); mask != 0; mask &= mask - 1) {
+                std::size_t index = group * groupSize + lowestBit(mask);
+                if (equal(slots[index].key, key)) return index;
+            }
+            if (matchByte(bytes, emptySlot) != 0) return capacity;
+            group = (group + step) & groupMask;
+        }
+    }
+
+    // First empty or deleted slot on the probe sequence of hash; the table is never full
+    std::size_t freeIndex(std::size_t hash) const {
+        std::size_t groupMask = capacity / groupSize - 1;
+        std::size_t group = firstGroup(hash);
+        for (std::size_t step = 1; ; ++step) {
+            std::uint32_t mask = matchFree(control + group * groupSize);
+            if (mask != 0) return group * groupSize + lowestBit(mask);
+            group = (group + step) & groupMask;
+        }
+    }
+
+    void allocate(std::size_t slotCount) {
+        control = new std::int8_t[slotCount];
+        std::memset(control, emptySlot, slotCount);
+        slots = std::allocator<Slot>().allocate(slotCount);
+        capacity = slotCount;
+    }
+
+    void release() {
+        if (capacity == 0) return;
+        for (std::size_t i = 0; i < capacity; ++i) {
+            if (control[i] >= 0) slots[i].~Slot();
+        }
+        std::allocator<Slot>().deallocate(slots, capacity);
+        delete[] control;
+        control = nullptr;
+        slots = nullptr;
+        capacity = 0;
+    }
+
+    void rehash(std::size_t slotCount) {
+        std::int8_t* oldControl = control;
+        Slot* oldSlots = slots;
+        std::size_t oldCapacity = capacity;
+
+        allocate(slotCount);
+        tombstones = 0;
+        for (std::size_t i = 0; i < oldCapacity; ++i) {
+            if (oldControl[i] < 0) continue;
+            std::size_t hash = hasher(oldSlots[i].key);
+            std::size_t index = freeIndex(hash);
+            control[index] = tagOf(hash);
+            new (&slots[index]) Slot{std::move(oldSlots[i].key), std::move(oldSlots[i].value)};
+            oldSlots[i].~Slot();
+        }
+        if (oldCapacity > 0) {
+            std::allocator<Slot>().deallocate(oldSlots, oldCapacity);
+            delete[] oldControl;
+        }
+    }
+
+    static std::size_t slotsFor(std::size_t entries) {
+        std::size_t slotCount = groupSize;
+        while (slotCount - slotCount / 8 < entries) slotCount *= 2;
+        return slotCount;
+    }
+
+    void growIfFull() {
+        if (capacity == 0) {
+            allocate(groupSize);
+        } else if (count + tombstones + 1 > capacity - capacity / 8) {
+            // Mostly tombstones: rebuild at the same size, otherwise double
+            rehash(count + 1 > capacity / 2 ? capacity * 2 : capacity);
+        }
+    }
+
+public:
+    FlatHashMap() = default;
+
+    // Same capacity and slot positions as other, so no key is hashed again
+    FlatHashMap(const FlatHashMap& other)
+        : count(other.count), tombstones(other.tombstones), hasher(other.hasher), equal(other.equal) {
+        if (other.capacity == 0) return;
+        allocate(other.capacity);
+        std::memcpy(control, other.control, capacity);
+        for (std::size_t i = 0; i < capacity; ++i) {
+            if (control[i] >= 0) new (&slots[i]) Slot(other.slots[i]);
+        }
+    }
+
+    FlatHashMap& operator=(const FlatHashMap& other) {
+        FlatHashMap copy(other);
+        swap(copy);
+        return *this;
+    }
+
+    FlatHashMap(FlatHashMap&& other) noexcept {
+        swap(other);
+    }
+
+    FlatHashMap& operator=(FlatHashMap&& other) noexcept {
+        FlatHashMap moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    ~FlatHashMap() {
+        release();
+    }
+
+    void swap(FlatHashMap& other) noexcept {
+        std::swap(control, other.control);
+        std::swap(slots, other.slots);
+        std::swap(capacity, other.capacity);
+        std::swap(count, other.count);
+        std::swap(tombstones, other.tombstones);
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    // Makes room for entries keys without growing again
+    void reserve(std::size_t entries) {
+        std::size_t slotCount = slotsFor(entries);
+        if (slotCount > capacity) rehash(slotCount);
+    }
+
+    void clear() {
+        release();
+        count = 0;
+        tombstones = 0;
+    }
+
+    template <typename K>
+    Value* find(const K& key) {
+        std::size_t index = findIndex(key, hasher(key));
+        return index == capacity ? nullptr : &slots[index].value;
+    }
+
+    template <typename K>
+    const Value* find(const K& key) const {
+        std::size_t index = findIndex(key, hasher(key));
+        return index == capacity ? nullptr : &slots[index].value;
+    }
+
+    template <typename K>
+    bool contains(const K& key) const {
+        return find(key) != nullptr;
+    }
+
+    // Inserts key with a Value built from args unless the key is present. Returns the value
+    // in the map and whether it was inserted. The Key is only built (from key) on insertion.
+    template <typename K, typename... Args>
+    std::pair<Value*, bool> tryEmplace(K&& key, Args&&... args) {
+        std::size_t hash = hasher(key);
+        std::size_t index = findIndex(key, hash);
+        if (index != capacity) return {&slots[index].value, false};
+
+        growIfFull();
+        index = freeIndex(hash);
+        if (control[index] == deletedSlot) --tombstones;
+        new (&slots[index]) Slot{Key(std::forward<K>(key)), Value(std::forward<Args>(args)...)};
+        control[index] = tagOf(hash);
+        ++count;
+        return {&slots[index].value, true};
+    }
+
+    // operator[] of std::unordered_map
+    template <typename K>
+    Value& operator[](K&& key) {
+        return *tryEmplace(std::forward<K>(key)).first;
+    }
+
+    template <typename K>
+    bool erase(const K& key) {
+        std::size_t index = findIndex(key, hasher(key));
+        if (index == capacity) return false;
+        slots[index].~Slot();
+        // A group that still has an empty byte never sent a probe on to the next group,
+        // so the slot can become empty again; otherwise it must stay a tombstone.
+        const std::int8_t* group = control + (index / groupSize) * groupSize;
+        if (matchByte(group, emptySlot) != 0) {
+            control[index] = emptySlot;
+        } else {
+            control[index] = deletedSlot;
+            ++tombstones;
+        }
+        --count;
+        return true;
+    }
+
+    // Calls fn(key, value) for every entry, in slot order
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            if (control[i] >= 0) fn(slots[i].key, slots[i].value);
+        }
+    }
+
+    // Heap bytes of the table itself (not counting memory owned by the keys and values)
+    std::size_t memoryUsage() const {
+        return capacity * (sizeof(Slot) + 1);
+    }
+};
+
+#endif // FLATHASHMAP_H
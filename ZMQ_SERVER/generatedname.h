@@ -0,0 +1,85 @@
+#ifndef GENERATEDNAME_H
+#define GENERATEDNAME_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string_view>
+
+// Username the server hands out at registration: "User_" followed by 8 base62 characters.
+// The 8 characters are packed into one integer (62^8 < 2^48), so the server stores,
+// hashes and compares usernames as a 64-bit value. It only becomes text at the protocol
+// boundary, when a reply is written or a message is parsed.
+class GeneratedName {
+public:
+    static constexpr std::string_view prefix = "User_";
+    static constexpr std::size_t digits = 8;
+    static constexpr std::size_t textSize = prefix.size() + digits;
+    static constexpr std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+    // Text form, for Schema::encode and logging
+    struct Text {
+        std::array<char, textSize> chars;
+        operator std::string_view() const { return std::string_view(chars.data(), chars.size()); }
+    };
+
+    struct Hash {
+        std::size_t operator()(GeneratedName name) const {
+            // The value is a base62 number, mix it so every bit of the hash depends on every digit
+            std::uint64_t x = name.value * 0x9E3779B97F4A7C15ull;
+            return static_cast<std::size_t>(x ^ (x >> 29));
+        }
+    };
+
+private:
+    std::uint64_t value = 0;
+
+    static int digitOf(char c) {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        return -1;
+    }
+
+public:
+    GeneratedName() = default;
+    explicit GeneratedName(std::uint64_t packed) : value(packed) {}
+
+    // Parses "User_xxxxxxxx"; false for anything else
+    static bool parse(std::string_view text, GeneratedName& name) {
+        if (text.size() != textSize || text.substr(0, prefix.size()) != prefix) return false;
+        std::uint64_t packed = 0;
+        for (char c : text.substr(prefix.size())) {
+            int digit = digitOf(c);
+            if (digit < 0) return false;
+            packed = packed * alphabet.size() + static_cast<std::uint64_t>(digit);
+        }
+        name = GeneratedName(packed);
+        return true;
+    }
+
+    std::uint64_t packed() const {
+        return value;
+    }
+
+    Text text() const {
+        Text result;
+        prefix.copy(result.chars.data(), prefix.size());
+        std::uint64_t rest = value;
+        for (std::size_t i = textSize; i > prefix.size(); --i) {
+            result.chars[i - 1] = alphabet[rest % alphabet.size()];
+            rest /= alphabet.size();
+        }
+        return result;
+    }
+
+    bool operator==(GeneratedName other) const { return value == other.value; }
+    bool operator!=(GeneratedName other) const { return value != other.value; }
+};
+
+inline std::ostream& operator<<(std::ostream& out, GeneratedName name) {
+    return out << std::string_view(name.text());
+}
+
+#endif // GENERATEDNAME_H
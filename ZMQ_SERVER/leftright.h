@@ -0,0 +1,121 @@
+#ifndef LEFTRIGHT_H
+#define LEFTRIGHT_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Counts the readers inside one version. Readers register in one of several padded slots
+// (picked per thread) so they do not all bounce the same cache line.
+class ReadIndicator {
+private:
+    static const std::size_t slotCount = 16;
+
+    struct alignas(64) Slot {
+        std::atomic<long> readers{0};
+    };
+
+    Slot slots[slotCount];
+
+    static std::size_t threadSlot() {
+        static std::atomic<std::size_t> nextThread{0};
+        thread_local std::size_t slot = nextThread.fetch_add(1, std::memory_order_relaxed) % slotCount;
+        return slot;
+    }
+
+public:
+    void arrive() {
+        slots[threadSlot()].readers.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    void depart() {
+        slots[threadSlot()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool isEmpty() const {
+        for (const Slot& slot : slots) {
+            if (slot.readers.load(std::memory_order_seq_cst) != 0) return false;
+        }
+        return true;
+    }
+};
+
+// Left-right concurrency control: two copies of T, readers use one while the writer
+// updates the other. read() never takes a lock or waits: it announces itself on a read
+// indicator and gets a copy no writer touches until it leaves, so every read sees one
+// consistent state. write() applies its change to the idle copy, points the readers at
+// it, waits until the last reader has left the old copy and applies the same change there.
+//
+// The write function runs twice, on both copies, and must have the same effect both times.
+// Writers are serialized by a mutex and pay for the wait; reads scale with the cores.
+template <typename T>
+class LeftRight {
+private:
+    T instances[2];
+    std::atomic<int> readIndex{0};    // the copy readers use
+    std::atomic<int> versionIndex{0}; // the indicator new readers arrive on
+    mutable ReadIndicator indicators[2]; // arriving is not a change of the protected state
+    std::mutex writerMutex;
+
+    static void waitUntilEmpty(const ReadIndicator& indicator) {
+        while (!indicator.isEmpty()) std::this_thread::yield();
+    }
+
+    // Afterwards no reader can still be using the copy readIndex pointed at before
+    void toggleVersionAndWait() {
+        int previous = versionIndex.load(std::memory_order_relaxed);
+        int next = 1 - previous;
+        waitUntilEmpty(indicators[next]);
+        versionIndex.store(next, std::memory_order_seq_cst);
+        waitUntilEmpty(indicators[previous]);
+    }
+
+public:
+    LeftRight() = default;
+    LeftRight(const LeftRight&) = delete;
+    LeftRight& operator=(const LeftRight&) = delete;
+
+    // Runs fn(const T&) and returns its result
+    template <typename Fn>
+    auto read(Fn&& fn) const -> decltype(fn(std::declval<const T&>())) {
+        ReadIndicator& indicator = indicators[versionIndex.load(std::memory_order_seq_cst)];
+        indicator.arrive();
+        struct Departure {
+            ReadIndicator& indicator;
+            ~Departure() { indicator.depart(); }
+        } departure{indicator};
+        return fn(instances[readIndex.load(std::memory_order_seq_cst)]);
+    }
+
+    // Runs fn(T&) on both copies and returns the result of the second run
+    template <typename Fn>
+    auto write(Fn&& fn) -> decltype(fn(std::declval<T&>())) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        int current = readIndex.load(std::memory_order_relaxed);
+        fn(instances[1 - current]);
+        readIndex.store(1 - current, std::memory_order_seq_cst);
+        toggleVersionAndWait();
+        return fn(instances[current]);
+    }
+
+    // Like write(), for changes that may turn out to be no-ops: fn(T&, bool& changed) sets
+    // changed when it modified the copy. When the first run changed nothing, the readers are
+    // not switched and fn does not run again, so a failed check costs no wait for readers.
+    template <typename Fn>
+    auto update(Fn&& fn) -> decltype(fn(std::declval<T&>(), std::declval<bool&>())) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        int current = readIndex.load(std::memory_order_relaxed);
+        bool changed = false;
+        auto result = fn(instances[1 - current], changed);
+        if (!changed) return result;
+        readIndex.store(1 - current, std::memory_order_seq_cst);
+        toggleVersionAndWait();
+        changed = false;
+        return fn(instances[current], changed);
+    }
+};
+
+#endif // LEFTRIGHT_H
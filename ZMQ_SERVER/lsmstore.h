@@ -0,0 +1,538 @@
+#ifndef LSMSTORE_H
+#define LSMSTORE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include "coldstore.h"
+#include "serverstats.h"
+#include "writeaheadlog.h"
+
+// Files of LsmStore. Every run is one file, written once and never changed:
+//   blocks = entries sorted by name, cut into blocks of about blockSize bytes;
+//            entry = u16 name size | name | u32 value size | value (coldformat)
+//   index  = u32 block count | per block: u16 first name size | first name | u64 offset
+//            | u32 size | u32 crc32 of the block
+//            | u32 bloom filter words | the words (u64)
+//   footer = u64 index offset | u64 index size | u64 entry count | u32 version
+//            | u32 crc32 of the index | magic "BNCOLD\0\0"
+// Little endian throughout. Only the index and the bloom filter are kept in memory, about
+// 2 bytes per stored name.
+namespace lsmformat {
+
+const char magic[8] = {'B', 'N', 'C', 'O', 'L', 'D', '\0', '\0'};
+const std::uint32_t version = 1;
+const std::size_t footerSize = 40;
+const std::size_t blockSize = 4096;
+const std::size_t bloomBitsPerName = 10; // about 1% false positives with 7 probes
+const std::size_t bloomProbes = 7;
+
+inline void appendInt(std::string& out, std::uint64_t value, std::size_t bytes) {
+    char encoded[8];
+    mutationformat::putInt(encoded, value, bytes);
+    out.append(encoded, bytes);
+}
+
+// FNV-1a, mixed. The bloom filters are stored, so the hash must be the same in every
+// build, which std::hash does not promise.
+inline std::uint64_t hashName(std::string_view name) {
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001B3ull;
+    }
+    hash = (hash ^ (hash >> 32)) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 29);
+}
+
+class BloomFilter {
+private:
+    std::vector<std::uint64_t> words;
+
+    // Calls fn(bit) for the probes of name (double hashing)
+    template <typename Fn>
+    void forEachProbe(std::string_view name, Fn&& fn) const {
+        std::uint64_t hash = hashName(name);
+        std::uint64_t step = (hash >> 32) | 1;
+        std::uint64_t bits = words.size() * 64;
+        for (std::size_t i = 0; i < bloomProbes; ++i, hash += step) fn(hash % bits);
+    }
+
+public:
+    BloomFilter() = default;
+    explicit BloomFilter(std::size_t names) : words(names * bloomBitsPerName / 64 + 1) {}
+
+    void add(std::string_view name) {
+        forEachProbe(name, [this](std::uint64_t bit) { words[bit / 64] |= 1ull << (bit % 64); });
+    }
+
+    bool mayContain(std::string_view name) const {
+        bool found = true;
+        forEachProbe(name, [&](std::uint64_t bit) { found = found && ((words[bit / 64] >> (bit % 64)) & 1) != 0; });
+        return found;
+    }
+
+    std::vector<std::uint64_t>& data() { return words; }
+    const std::vector<std::uint64_t>& data() const { return words; }
+};
+
+// Reads the entry at pos of a block and moves pos past it; false at the end or on a bad entry
+inline bool nextEntry(const std::string& block, std::size_t& pos, std::string_view& name, std::string_view& value) {
+    if (pos + 2 > block.size()) return false;
+    std::size_t nameSize = static_cast<std::size_t>(mutationformat::getInt(block.data() + pos, 2));
+    if (pos + 2 + nameSize + 4 > block.size()) return false;
+    name = std::string_view(block.data() + pos + 2, nameSize);
+    pos += 2 + nameSize;
+    std::size_t valueSize = static_cast<std::size_t>(mutationformat::getInt(block.data() + pos, 4));
+    if (pos + 4 + valueSize > block.size()) return false;
+    value = std::string_view(block.data() + pos + 4, valueSize);
+    pos += 4 + valueSize;
+    return true;
+}
+
+// Writes one run, entries in name order
+class RunWriter {
+private:
+    std::FILE* file;
+    std::string block;
+    std::string index;
+    std::uint32_t blockCount = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t entries = 0;
+    BloomFilter bloom;
+    bool failed = false;
+
+    void flushBlock() {
+        if (block.empty()) return;
+        std::size_t nameSize = static_cast<std::size_t>(mutationformat::getInt(block.data(), 2));
+        appendInt(index, nameSize, 2);
+        index.append(block, 2, nameSize);
+        appendInt(index, offset, 8);
+        appendInt(index, block.size(), 4);
+        appendInt(index, mutationformat::crc32(block.data(), block.size()), 4);
+        if (std::fwrite(block.data(), 1, block.size(), file) != block.size()) failed = true;
+        offset += block.size();
+        ++blockCount;
+        block.clear();
+    }
+
+public:
+    // names is at least the number of entries that will be added, for the bloom filter
+    RunWriter(std::FILE* output, std::size_t names) : file(output), bloom(names) {}
+
+    // name is at most mutationformat::maxTextSize long (put refuses longer ones)
+    void add(std::string_view name, std::string_view value) {
+        appendInt(block, name.size(), 2);
+        block.append(name.data(), name.size());
+        appendInt(block, value.size(), 4);
+        block.append(value.data(), value.size());
+        bloom.add(name);
+        ++entries;
+        if (block.size() >= blockSize) flushBlock();
+    }
+
+    // Writes the index and footer and forces the run to disk
+    bool finish() {
+        flushBlock();
+        std::string tail;
+        appendInt(tail, blockCount, 4);
+        tail += index;
+        appendInt(tail, bloom.data().size(), 4);
+        for (std::uint64_t word : bloom.data()) appendInt(tail, word, 8);
+        std::uint32_t indexCrc = mutationformat::crc32(tail.data(), tail.size());
+        std::uint64_t indexSize = tail.size();
+        appendInt(tail, offset, 8);
+        appendInt(tail, indexSize, 8);
+        appendInt(tail, entries, 8);
+        appendInt(tail, version, 4);
+        appendInt(tail, indexCrc, 4);
+        tail.append(magic, sizeof(magic));
+        if (std::fwrite(tail.data(), 1, tail.size(), file) != tail.size() || std::fflush(file) != 0) failed = true;
+        syncToDisk(file);
+        return !failed;
+    }
+};
+
+// An opened run: its index and bloom filter, and a handle for lookups
+struct Run {
+    struct Block {
+        std::uint64_t offset;
+        std::uint32_t size;
+        std::uint32_t crc;
+    };
+
+    std::uint64_t number = 0;
+    std::string path;
+    std::uint64_t entries = 0;
+    std::uint64_t fileSize = 0;
+    std::vector<std::string> firstNames;
+    std::vector<Block> blocks;
+    BloomFilter bloom;
+    std::ifstream file;
+
+    bool open(const std::string& runPath, std::uint64_t runNumber) {
+        path = runPath;
+        number = runNumber;
+        file.open(path, std::ios::binary | std::ios::ate);
+        if (!file) return false;
+        fileSize = static_cast<std::uint64_t>(file.tellg());
+        if (fileSize < footerSize) return false;
+
+        char footer[footerSize];
+        file.seekg(static_cast<std::streamoff>(fileSize - footerSize));
+        if (!file.read(footer, footerSize) || std::memcmp(footer + 32, magic, sizeof(magic)) != 0) return false;
+        std::uint64_t indexOffset = mutationformat::getInt(footer, 8);
+        std::uint64_t indexSize = mutationformat::getInt(footer + 8, 8);
+        entries = mutationformat::getInt(footer + 16, 8);
+        if (mutationformat::getInt(footer + 24, 4) != version) return false;
+        if (indexOffset + indexSize + footerSize != fileSize) return false;
+
+        std::string index(static_cast<std::size_t>(indexSize), '\0');
+        file.seekg(static_cast<std::streamoff>(indexOffset));
+        if (!file.read(&index[0], static_cast<std::streamsize>(index.size()))) return false;
+        if (mutationformat::crc32(index.data(), index.size()) != mutationformat::getInt(footer + 28, 4)) return false;
+
+        std::size_t pos = 0;
+        auto getInt = [&](std::size_t bytes) {
+            if (pos + bytes > index.size()) {
+                pos = index.size() + 1;
+                return std::uint64_t(0);
+            }
+            std::uint64_t value = mutationformat::getInt(index.data() + pos, bytes);
+            pos += bytes;
+            return value;
+        };
+        std::size_t blockCount = static_cast<std::size_t>(getInt(4));
+        for (std::size_t i = 0; i < blockCount && pos <= index.size(); ++i) {
+            std::size_t nameSize = static_cast<std::size_t>(getInt(2));
+            if (pos + nameSize > index.size()) return false;
+            firstNames.emplace_back(index.data() + pos, nameSize);
+            pos += nameSize;
+            Block block;
+            block.offset = getInt(8);
+            block.size = static_cast<std::uint32_t>(getInt(4));
+            block.crc = static_cast<std::uint32_t>(getInt(4));
+            if (block.offset + block.size > indexOffset) return false;
+            blocks.push_back(block);
+        }
+        std::size_t words = static_cast<std::size_t>(getInt(4));
+        if (pos > index.size() || words * 8 != index.size() - pos) return false;
+        bloom.data().resize(words);
+        for (std::uint64_t& word : bloom.data()) word = getInt(8);
+        return blocks.size() == blockCount && words > 0;
+    }
+
+    // The block that holds name if the run has it, or blocks.size()
+    std::size_t blockFor(std::string_view name) const {
+        auto after = std::upper_bound(firstNames.begin(), firstNames.end(), name,
+                                      [](std::string_view key, const std::string& first) { return key < first; });
+        if (after == firstNames.begin()) return blocks.size();
+        return static_cast<std::size_t>(after - firstNames.begin()) - 1;
+    }
+
+    // Reads block i through in into data and checks it
+    bool readBlock(std::ifstream& in, std::size_t i, std::string& data) const {
+        data.resize(blocks[i].size);
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(blocks[i].offset));
+        return in.read(&data[0], static_cast<std::streamsize>(data.size()))
+            && mutationformat::crc32(data.data(), data.size()) == blocks[i].crc;
+    }
+};
+
+// Reads the entries of a run in order, for merging
+class RunCursor {
+private:
+    const Run& run;
+    std::ifstream in;
+    std::size_t nextBlock = 0;
+    std::string block;
+    std::size_t pos = 0;
+
+public:
+    std::string_view name;
+    std::string_view value;
+    bool failed = false;
+
+    explicit RunCursor(const Run& source) : run(source), in(source.path, std::ios::binary) {}
+
+    // Moves to the next entry; the views stay valid until the next call
+    bool next() {
+        while (!nextEntry(block, pos, name, value)) {
+            if (pos < block.size() || nextBlock == run.blocks.size()) {
+                failed = failed || pos < block.size();
+                return false;
+            }
+            if (!run.readBlock(in, nextBlock++, block)) {
+                failed = true;
+                return false;
+            }
+            pos = 0;
+        }
+        return true;
+    }
+};
+
+} // namespace lsmformat
+
+// ColdStore on disk, log-structured without a memtable: UserManager evicts in batches, and
+// every put() sorts its batch and writes it as one new run. A lookup checks the runs from new
+// to old, skipping those whose bloom filter rules the name out, so a name that was never
+// evicted (a new registration) costs no disk read. Merging the newest run into the one
+// before it while that one is at most twice as large keeps the number of runs logarithmic
+// in the stored names and drops the older versions of a name.
+//
+// A put() and its merges run on the shard that evicts, the store lock is only held to
+// swap in the new runs. Lookups share one file handle per run, behind that lock.
+class LsmStore : public ColdStore {
+private:
+    using Run = lsmformat::Run;
+
+    std::string directory;
+    std::mutex runsMutex; // runs and their file handles
+    std::vector<std::shared_ptr<Run>> runs; // oldest first
+    std::mutex writeMutex; // one put() or merge at a time
+    std::uint64_t nextNumber = 1;
+
+    ServerStats& stats;
+    std::size_t statsSection;
+    std::atomic<std::uint64_t> merges{0};
+    std::atomic<std::uint64_t> blockReads{0};
+    std::uint64_t last[6] = {}; // counters at the previous report, only used by the reporter
+
+    std::string runPath(std::uint64_t number) const {
+        std::ostringstream name;
+        name << "run-" << std::setw(8) << std::setfill('0') << number << ".cold";
+        return (std::filesystem::path(directory) / name.str()).string();
+    }
+
+    // Writes a new run with fill(RunWriter&) and opens it; null when that failed
+    template <typename Fn>
+    std::shared_ptr<Run> writeRun(std::size_t names, Fn&& fill) {
+        std::uint64_t number = nextNumber++;
+        std::string path = runPath(number);
+        std::string temporary = path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "[ColdStore] Kan niet schrijven naar " << temporary << std::endl;
+            return nullptr;
+        }
+        lsmformat::RunWriter writer(file, names);
+        bool ok = fill(writer) && writer.finish();
+        std::fclose(file);
+
+        std::error_code error;
+        if (ok) std::filesystem::rename(temporary, path, error);
+        auto run = std::make_shared<Run>();
+        if (!ok || error || !run->open(path, number)) {
+            std::cerr << "[ColdStore] Schrijven van " << path << " mislukt" << std::endl;
+            std::filesystem::remove(temporary, error);
+            std::filesystem::remove(path, error);
+            return nullptr;
+        }
+        return run;
+    }
+
+    // Replaces the two newest runs by their merge while the newer one is at least half the
+    // size of the older one. A failed merge leaves both runs in place.
+    void mergeNewest() {
+        while (true) {
+            std::shared_ptr<Run> older, newer;
+            {
+                std::lock_guard<std::mutex> lock(runsMutex);
+                std::size_t count = runs.size();
+                if (count < 2 || runs[count - 2]->entries > 2 * runs[count - 1]->entries) return;
+                older = runs[count - 2];
+                newer = runs[count - 1];
+            }
+
+            std::shared_ptr<Run> merged = writeRun(static_cast<std::size_t>(older->entries + newer->entries),
+                                                   [&](lsmformat::RunWriter& writer) {
+                lsmformat::RunCursor a(*older), b(*newer);
+                bool hasA = a.next(), hasB = b.next();
+                while (hasA || hasB) {
+                    if (hasB && (!hasA || b.name <= a.name)) {
+                        // Equal names: the newer run has the current version
+                        if (hasA && a.name == b.name) hasA = a.next();
+                        writer.add(b.name, b.value);
+                        hasB = b.next();
+                    } else {
+                        writer.add(a.name, a.value);
+                        hasA = a.next();
+                    }
+                }
+                return !a.failed && !b.failed;
+            });
+            if (!merged) return;
+
+            {
+                std::lock_guard<std::mutex> lock(runsMutex);
+                runs.pop_back();
+                runs.back() = merged;
+            }
+            // The lookups hold no reference outside the lock, so the files are closed now
+            std::string olderPath = older->path, newerPath = newer->path;
+            older.reset();
+            newer.reset();
+            std::error_code error;
+            std::filesystem::remove(olderPath, error);
+            std::filesystem::remove(newerPath, error);
+            merges.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void printStats(std::ostream& out) {
+        std::uint64_t now[6] = {counters.hits.load(), counters.loads.load(), counters.misses.load(),
+                                counters.evictedNames.load(), counters.evictedRows.load(), merges.load()};
+        std::uint64_t delta[6];
+        for (int i = 0; i < 6; ++i) {
+            delta[i] = now[i] - last[i];
+            last[i] = now[i];
+        }
+        std::size_t runCount;
+        std::uint64_t names = 0, bytes = 0;
+        {
+            std::lock_guard<std::mutex> lock(runsMutex);
+            runCount = runs.size();
+            for (const auto& run : runs) {
+                names += run->entries;
+                bytes += run->fileSize;
+            }
+        }
+        std::uint64_t found = delta[0] + delta[1];
+        out << "  [users] in geheugen: " << std::fixed << std::setprecision(1)
+            << (found > 0 ? 100.0 * delta[0] / found : 100.0) << "% ("
+            << delta[1] << " van schijf geladen, " << delta[2] << " onbekend), "
+            << delta[3] << " namen (" << delta[4] << " registraties) naar schijf; opslag: "
+            << runCount << " runs, " << names << " namen, " << bytes / 1048576.0 << " MB, "
+            << delta[5] << " merges" << std::endl;
+    }
+
+public:
+    // Opens the runs in directory, creating it when needed. Unfinished runs of a run that
+    // stopped while writing are removed; a damaged run is skipped with a warning.
+    LsmStore(const std::string& storeDirectory, ServerStats& serverStats)
+        : directory(storeDirectory), stats(serverStats) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::vector<std::pair<std::uint64_t, std::string>> found;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+            std::string file = entry.path().filename().string();
+            if (file.size() > 4 && file.compare(file.size() - 4, 4, ".tmp") == 0) {
+                std::filesystem::remove(entry.path(), error);
+            } else if (file.size() == 17 && file.compare(0, 4, "run-") == 0 && file.compare(12, 5, ".cold") == 0
+                       && std::all_of(file.begin() + 4, file.begin() + 12, [](char c) { return c >= '0' && c <= '9'; })) {
+                found.emplace_back(std::stoull(file.substr(4, 8)), entry.path().string());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        for (const auto& [number, path] : found) {
+            auto run = std::make_shared<Run>();
+            if (run->open(path, number)) {
+                runs.push_back(std::move(run));
+            } else {
+                std::cerr << "[ColdStore] " << path << " is beschadigd en wordt overgeslagen" << std::endl;
+            }
+            nextNumber = number + 1;
+        }
+        statsSection = stats.addSection([this](std::ostream& out, double) {
+            printStats(out);
+        });
+    }
+
+    LsmStore(const LsmStore&) = delete;
+    LsmStore& operator=(const LsmStore&) = delete;
+
+    ~LsmStore() override {
+        stats.removeSection(statsSection);
+    }
+
+    bool put(std::vector<ColdUser>& users) override {
+        if (users.empty()) return true;
+        for (const ColdUser& user : users) {
+            if (!coldformat::fits(user)) return false;
+        }
+        std::lock_guard<std::mutex> writeLock(writeMutex);
+        std::sort(users.begin(), users.end(), [](const ColdUser& a, const ColdUser& b) { return a.name < b.name; });
+        std::shared_ptr<Run> run = writeRun(users.size(), [&](lsmformat::RunWriter& writer) {
+            std::string value;
+            for (const ColdUser& user : users) {
+                coldformat::encode(user, value);
+                writer.add(user.name, value);
+            }
+            return true;
+        });
+        if (!run) return false;
+        {
+            std::lock_guard<std::mutex> lock(runsMutex);
+            runs.push_back(std::move(run));
+        }
+        mergeNewest();
+        return true;
+    }
+
+    bool get(std::string_view name, ColdUser& user) override {
+        std::lock_guard<std::mutex> lock(runsMutex);
+        std::string block;
+        for (auto it = runs.rbegin(); it != runs.rend(); ++it) {
+            Run& run = **it;
+            if (!run.bloom.mayContain(name)) continue;
+            std::size_t index = run.blockFor(name);
+            if (index == run.blocks.size()) continue;
+            blockReads.fetch_add(1, std::memory_order_relaxed);
+            if (!run.readBlock(run.file, index, block)) {
+                std::cerr << "[ColdStore] Blok " << index << " van " << run.path << " is beschadigd" << std::endl;
+                continue;
+            }
+            std::size_t pos = 0;
+            std::string_view entryName, value;
+            while (lsmformat::nextEntry(block, pos, entryName, value) && entryName <= name) {
+                if (entryName == name) {
+                    user.name = name;
+                    return coldformat::decode(value, user);
+                }
+            }
+        }
+        return false;
+    }
+
+    // Removes every run, for a server that keeps no users across restarts
+    void clear() {
+        std::lock_guard<std::mutex> writeLock(writeMutex);
+        std::vector<std::shared_ptr<Run>> removed;
+        {
+            std::lock_guard<std::mutex> lock(runsMutex);
+            removed.swap(runs);
+        }
+        for (auto& run : removed) {
+            std::string path = run->path;
+            run.reset();
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+    }
+
+    std::size_t runCount() {
+        std::lock_guard<std::mutex> lock(runsMutex);
+        return runs.size();
+    }
+
+    std::uint64_t blockReadCount() const {
+        return blockReads.load(std::memory_order_relaxed);
+    }
+};
+
+#endif // LSMSTORE_H
@@ -0,0 +1,167 @@
+#ifndef MUTATION_H
+#define MUTATION_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "generatedname.h"
+
+// One change to the user state, as written to the write-ahead log.
+// A record names the registration it changes by client name and channel text, not by
+// UserId or ChannelId: those depend on the shard count and registration order of the
+// server that wrote it, the names do not.
+struct Mutation {
+    enum Kind : std::uint8_t {
+        registerUser = 1, // name, channel, username
+        setPassword = 2,  // name, channel, password
+        logIn = 3,        // name, channel
+        logOut = 4,       // name, channel
+        reserveUsernames = 5 // username = end of the reserved counters, password = key (see UsernameAllocator)
+    };
+
+    Kind kind = registerUser;
+    std::string_view name;
+    std::string_view channel;
+    GeneratedName username;
+    std::string_view password;
+};
+
+namespace mutationformat {
+
+// Record layout, little endian:
+//   u32 payload size | u32 crc32 of the payload | payload
+//   payload = u8 kind | u16 name size | name | u16 channel size | channel
+//             | u64 packed username | u16 password size | password
+// The checksum finds a record that was only partly written when the server stopped.
+const std::size_t headerSize = 8;
+
+// Longest name, channel or password a record holds. The server refuses longer names and
+// channels at registration and never makes longer passwords, so nothing is cut off.
+const std::size_t maxTextSize = 0xFFFF;
+
+// CRC-32 (the zlib polynomial), eight bytes per step with the slicing-by-8 tables.
+// Pass the result for the preceding bytes as previous to checksum data in pieces.
+inline std::uint32_t crc32(const char* data, std::size_t size, std::uint32_t previous = 0) {
+    static const struct Tables {
+        std::uint32_t entries[8][256];
+        Tables() {
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t c = i;
+                for (int bit = 0; bit < 8; ++bit) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[0][i] = c;
+            }
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                for (int t = 1; t < 8; ++t) entries[t][i] = (entries[t - 1][i] >> 8) ^ entries[0][entries[t - 1][i] & 0xFF];
+            }
+        }
+    } tables;
+    const auto& t = tables.entries;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+    std::uint32_t crc = previous ^ 0xFFFFFFFFu;
+    for (; size >= 8; size -= 8, bytes += 8) {
+        std::uint32_t low = crc ^ (bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<std::uint32_t>(bytes[3]) << 24);
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+            ^ t[3][bytes[4]] ^ t[2][bytes[5]] ^ t[1][bytes[6]] ^ t[0][bytes[7]];
+    }
+    for (; size > 0; --size, ++bytes) crc = t[0][(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Writes the low bytes of value at out and returns the position after them
+inline char* putInt(char* out, std::uint64_t value, std::size_t bytes) {
+    for (std::size_t i = 0; i < bytes; ++i) out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    return out + bytes;
+}
+
+inline std::uint64_t getInt(const char* data, std::size_t bytes) {
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i) value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    return value;
+}
+
+// Texts longer than maxTextSize are cut off (see there)
+inline std::size_t textSize(std::string_view text) {
+    return text.size() < maxTextSize ? text.size() : maxTextSize;
+}
+
+inline char* putText(char* out, std::string_view text) {
+    std::size_t size = textSize(text);
+    out = putInt(out, size, 2);
+    if (size > 0) std::memcpy(out, text.data(), size);
+    return out + size;
+}
+
+// Appends the record of mutation to out, growing it once, with its checksum left 0
+// (see seal). The write-ahead log seals a whole batch on its writer thread.
+inline void encodeUnsealed(const Mutation& mutation, std::string& out) {
+    std::size_t payloadSize = 1 + 2 + textSize(mutation.name) + 2 + textSize(mutation.channel)
+                            + 8 + 2 + textSize(mutation.password);
+    std::size_t start = out.size();
+    out.resize(start + headerSize + payloadSize);
+
+    char* pos = putInt(&out[start], payloadSize, 4) + 4;
+    *pos++ = static_cast<char>(mutation.kind);
+    pos = putText(pos, mutation.name);
+    pos = putText(pos, mutation.channel);
+    pos = putInt(pos, mutation.username.packed(), 8);
+    putText(pos, mutation.password);
+}
+
+// Fills in the checksums of the complete records in data[0, size), returns their number
+inline std::size_t seal(char* data, std::size_t size) {
+    std::size_t count = 0;
+    std::size_t pos = 0;
+    while (size - pos >= headerSize) {
+        std::size_t payloadSize = static_cast<std::size_t>(getInt(data + pos, 4));
+        if (payloadSize > size - pos - headerSize) break;
+        putInt(data + pos + 4, crc32(data + pos + headerSize, payloadSize), 4);
+        pos += headerSize + payloadSize;
+        ++count;
+    }
+    return count;
+}
+
+// Appends the complete record of mutation to out
+inline void encode(const Mutation& mutation, std::string& out) {
+    std::size_t start = out.size();
+    encodeUnsealed(mutation, out);
+    seal(&out[start], out.size() - start);
+}
+
+// Decodes the record at the start of data into mutation (its views point into data).
+// Returns the size of the record, or 0 when data does not start with a complete, intact record.
+inline std::size_t decode(const char* data, std::size_t size, Mutation& mutation) {
+    if (size < headerSize) return 0;
+    std::size_t payloadSize = static_cast<std::size_t>(getInt(data, 4));
+    if (payloadSize > size - headerSize) return 0;
+    const char* payload = data + headerSize;
+    if (crc32(payload, payloadSize) != static_cast<std::uint32_t>(getInt(data + 4, 4))) return 0;
+
+    std::size_t pos = 0;
+    auto text = [&](std::string_view& value) {
+        if (pos + 2 > payloadSize) return false;
+        std::size_t length = static_cast<std::size_t>(getInt(payload + pos, 2));
+        pos += 2;
+        if (pos + length > payloadSize) return false;
+        value = std::string_view(payload + pos, length);
+        pos += length;
+        return true;
+    };
+
+    if (payloadSize < 1) return 0;
+    std::uint8_t kind = static_cast<std::uint8_t>(payload[pos++]);
+    if (kind < Mutation::registerUser || kind > Mutation::reserveUsernames) return 0;
+    mutation.kind = static_cast<Mutation::Kind>(kind);
+    if (!text(mutation.name) || !text(mutation.channel)) return 0;
+    if (pos + 8 > payloadSize) return 0;
+    mutation.username = GeneratedName(getInt(payload + pos, 8));
+    pos += 8;
+    if (!text(mutation.password)) return 0;
+    return headerSize + payloadSize;
+}
+
+} // namespace mutationformat
+
+#endif // MUTATION_H
@@ -0,0 +1,182 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <zmq.hpp>
+#include "spscring.h"
+#include "usermanager.h"
+#include "requesthandler.h"
+#include "serverstats.h"
+
+// Counters of one pipeline stage, written by the stage thread and read by the reporter
+struct StageStats {
+    std::atomic<std::uint64_t> messages{0};
+    std::atomic<std::uint64_t> busyNanos{0};    // time spent working on messages
+    std::atomic<std::uint64_t> blockedNanos{0}; // time spent waiting on a full output queue
+
+    void add(std::atomic<std::uint64_t>& counter, std::chrono::steady_clock::duration duration) {
+        counter.fetch_add(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()), std::memory_order_relaxed);
+    }
+};
+
+// Splits the server loop into three threads connected by SPSC rings:
+//   receive  : pullSocket.recv                         -> requestRing
+//   handle   : decode + dispatch to the RequestHandler -> replyRing
+//   publish  : pubSocket.send
+// Socket I/O overlaps with the handler work. Its statistics section prints, per stage, the
+// depth of its input queue and where its time went, so the slowest stage stands out.
+class Pipeline {
+private:
+    static const std::size_t ringCapacity = 4096;
+
+    zmq::socket_t& pullSocket;
+    zmq::socket_t& pubSocket;
+    UserShards& userShards;
+    ServerStats& stats;
+    std::size_t statsSection;
+    std::uint64_t last[3][3] = {}; // counters at the previous report, only touched by the reporter
+
+    SpscRing<zmq::message_t> requestRing;
+    SpscRing<zmq::message_t> replyRing;
+
+    StageStats receiveStats;
+    StageStats handleStats;
+    StageStats publishStats;
+
+    std::vector<std::thread> stages;
+
+    // Waiting for requests is idle time; taking them off the socket counts as busy, so the
+    // receive stage shows its cost per message like the other stages
+    void receiveStage() {
+        zmq::pollitem_t items[] = {{ static_cast<void*>(pullSocket), 0, ZMQ_POLLIN, 0 }};
+        while (true) {
+            zmq::poll(items, 1, -1);
+            while (true) {
+                auto start = std::chrono::steady_clock::now();
+                zmq::message_t request;
+                if (!pullSocket.recv(&request, ZMQ_DONTWAIT)) break;
+                auto received = std::chrono::steady_clock::now();
+                receiveStats.add(receiveStats.busyNanos, received - start);
+
+                requestRing.push(request);
+                receiveStats.add(receiveStats.blockedNanos, std::chrono::steady_clock::now() - received);
+                receiveStats.messages.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void handleStage() {
+        RequestHandler handler(userShards, stats, "handle");
+        std::chrono::steady_clock::duration blocked{};
+        Publish publish = [this, &blocked](zmq::message_t&& reply) {
+            auto start = std::chrono::steady_clock::now();
+            replyRing.push(reply);
+            blocked += std::chrono::steady_clock::now() - start;
+        };
+
+        // Expired sessions are logged out between requests and while the ring is empty
+        unsigned spins = 0;
+        while (true) {
+            zmq::message_t request;
+            if (!requestRing.tryPop(request)) {
+                if (handler.expireSessions()) spins = 0;
+                else SpscRing<zmq::message_t>::backoff(spins++);
+                continue;
+            }
+            spins = 0;
+
+            auto start = std::chrono::steady_clock::now();
+            blocked = std::chrono::steady_clock::duration{};
+            handler.handle(benthernet::view(request), publish);
+            handler.expireSessions();
+
+            handleStats.add(handleStats.busyNanos, std::chrono::steady_clock::now() - start - blocked);
+            handleStats.add(handleStats.blockedNanos, blocked);
+            handleStats.messages.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void publishStage() {
+        while (true) {
+            zmq::message_t reply;
+            replyRing.pop(reply);
+
+            auto start = std::chrono::steady_clock::now();
+            pubSocket.send(reply);
+            publishStats.add(publishStats.busyNanos, std::chrono::steady_clock::now() - start);
+            publishStats.messages.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static void printStage(std::ostream& out, const char* name, StageStats& stats,
+                           std::uint64_t& lastMessages, std::uint64_t& lastBusy, std::uint64_t& lastBlocked,
+                           std::size_t queueDepth, bool hasQueue, double seconds) {
+        std::uint64_t messages = stats.messages.load(std::memory_order_relaxed);
+        std::uint64_t busy = stats.busyNanos.load(std::memory_order_relaxed);
+        std::uint64_t blocked = stats.blockedNanos.load(std::memory_order_relaxed);
+
+        std::uint64_t count = messages - lastMessages;
+        double busyPercent = seconds > 0 ? (busy - lastBusy) / (seconds * 1e7) : 0.0;
+        double blockedPercent = seconds > 0 ? (blocked - lastBlocked) / (seconds * 1e7) : 0.0;
+        double perMessage = count > 0 ? (busy - lastBusy) / 1000.0 / count : 0.0;
+
+        out << "  " << std::left << std::setw(10) << name << std::right
+            << " msgs " << std::setw(8) << count;
+        if (hasQueue) out << "  queue " << std::setw(5) << queueDepth;
+        else out << "  queue     -";
+        out << std::fixed << std::setprecision(1)
+            << "  busy " << std::setw(5) << busyPercent << "%"
+            << "  blocked " << std::setw(5) << blockedPercent << "%"
+            << std::setprecision(2) << "  " << perMessage << " us/msg" << std::endl;
+
+        lastMessages = messages;
+        lastBusy = busy;
+        lastBlocked = blocked;
+    }
+
+public:
+    Pipeline(zmq::socket_t& pull, zmq::socket_t& pub, UserShards& shards, ServerStats& serverStats)
+        : pullSocket(pull), pubSocket(pub), userShards(shards), stats(serverStats),
+        requestRing(ringCapacity), replyRing(ringCapacity)
+    {
+        statsSection = stats.addSection([this](std::ostream& out, double seconds) {
+            printStats(out, seconds);
+        });
+    }
+
+    ~Pipeline() {
+        wait();
+        stats.removeSection(statsSection);
+    }
+
+    void start() {
+        stages.emplace_back(&Pipeline::receiveStage, this);
+        stages.emplace_back(&Pipeline::handleStage, this);
+        stages.emplace_back(&Pipeline::publishStage, this);
+        std::cout << "[Server] Pipeline gestart: receive -> handle -> publish" << std::endl;
+    }
+
+    // Blocks until the stages stop, which they never do
+    void wait() {
+        for (auto& stage : stages) {
+            if (stage.joinable()) stage.join();
+        }
+    }
+
+    // Stage statistics since the previous call, see ServerStats
+    void printStats(std::ostream& out, double seconds) {
+        printStage(out, "receive", receiveStats, last[0][0], last[0][1], last[0][2], 0, false, seconds);
+        printStage(out, "handle", handleStats, last[1][0], last[1][1], last[1][2], requestRing.size(), true, seconds);
+        printStage(out, "publish", publishStats, last[2][0], last[2][1], last[2][2], replyRing.size(), true, seconds);
+    }
+};
+
+#endif // PIPELINE_H
@@ -0,0 +1,526 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zmq.hpp>
+#include "channelregistry.h"
+#include "mutation.h"
+#include "serverstats.h"
+#include "snapshot.h"
+#include "usermanager.h"
+#include "writeaheadlog.h"
+
+// Primary/standby replication by shipping the write-ahead log. The primary streams the bytes
+// of its log as the writer puts them in the file; a follower applies the records to its own
+// shards, so it holds the same users and sessions and can take over the PULL/PUB endpoints
+// when the primary is gone. Positions are offsets in the primary's log, the same ones a
+// snapshot records: a follower that restarts loads its own snapshot and asks for the log
+// after it. Only a follower without a usable position gets a full snapshot from the primary.
+//
+// Every message is one ZMQ frame, little endian:
+//   follower -> primary (DEALER -> ROUTER)
+//     sync     'S' | u64 position | u8 has state  start streaming at position, or send a
+//                                                 snapshot first when there is no state
+//     ack      'A' | u64 position                 the records up to position are applied
+//   primary -> follower
+//     records  'R' | u64 start | u64 log end | u64 sent at | log bytes
+//              The bytes start at log position start and may end inside a record. log end is
+//              the end of the primary's log, sent at its clock in milliseconds since the epoch
+//              (the lag is only meaningful on one machine). Sent empty as a heartbeat.
+//     snapshot 'P' | u64 position | u64 total size | u64 offset | part of a snapshot file
+namespace replicationformat {
+
+const char syncMessage = 'S';
+const char ackMessage = 'A';
+const char recordsMessage = 'R';
+const char snapshotMessage = 'P';
+const std::size_t headerSize = 25; // records and snapshot messages, before their bytes
+
+inline std::uint64_t wallClockMillis() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// Message of type with up to three u64 fields and then bytes
+inline std::string encode(char type, std::initializer_list<std::uint64_t> fields,
+                          const char* bytes = nullptr, std::size_t size = 0) {
+    std::string message(1 + 8 * fields.size() + size, '\0');
+    message[0] = type;
+    char* pos = &message[1];
+    for (std::uint64_t field : fields) pos = mutationformat::putInt(pos, field, 8);
+    if (size > 0) std::memcpy(pos, bytes, size);
+    return message;
+}
+
+inline std::uint64_t field(const zmq::message_t& message, std::size_t index) {
+    return mutationformat::getInt(static_cast<const char*>(message.data()) + 1 + 8 * index, 8);
+}
+
+} // namespace replicationformat
+
+// Primary side: a thread that serves the log file to the followers on a ROUTER socket.
+// It reads what the log writer has written (WriteAheadLog::writtenPosition), so followers
+// never get records the primary itself could still lose to a crash of the server.
+// At most window bytes per follower are unacknowledged, which keeps the ROUTER below its
+// high-water mark: a ROUTER drops messages above it.
+class ReplicationSource {
+private:
+    static const std::size_t chunkSize = 1 << 20;          // log bytes per message
+    static const std::size_t snapshotChunkSize = 4 << 20;  // snapshot bytes per message
+    static const std::uint64_t window = 8 << 20;
+    static constexpr std::chrono::milliseconds pollInterval{5};
+    static constexpr std::chrono::milliseconds heartbeatInterval{500};
+    static constexpr std::chrono::seconds followerTimeout{10};
+
+    struct Follower {
+        std::string identity;
+        std::uint64_t sent = 0;  // log position the messages so far reach
+        std::uint64_t acked = 0; // log position the follower has applied
+        bool needsSnapshot = false;
+        std::chrono::steady_clock::time_point lastHeard;
+        std::chrono::steady_clock::time_point lastSent;
+    };
+
+    zmq::context_t& context;
+    std::string endpoint;
+    std::string logPath;
+    WriteAheadLog& log;
+    UserShards& shards;
+    const ChannelRegistry& channels;
+    ServerStats& stats;
+    std::size_t statsSection;
+
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    std::mutex followersMutex; // the reporter reads the followers
+    std::vector<Follower> followers;
+    std::atomic<std::uint64_t> logEnd{0};
+    std::atomic<std::uint64_t> snapshotsSent{0};
+    std::atomic<std::uint64_t> bytesSent{0};
+    std::uint64_t lastBytesSent = 0; // only used by the reporter
+
+    static void send(zmq::socket_t& socket, const std::string& identity, const std::string& message) {
+        socket.send(identity.data(), identity.size(), ZMQ_SNDMORE);
+        socket.send(message.data(), message.size(), 0);
+    }
+
+    Follower& followerFor(const std::string& identity) {
+        for (Follower& follower : followers) {
+            if (follower.identity == identity) return follower;
+        }
+        followers.emplace_back();
+        followers.back().identity = identity;
+        std::cout << "[Replicatie] Volger verbonden" << std::endl;
+        return followers.back();
+    }
+
+    void receive(zmq::socket_t& socket) {
+        using namespace replicationformat;
+        while (true) {
+            zmq::message_t identity, message;
+            if (!socket.recv(&identity, ZMQ_DONTWAIT)) return;
+            if (!identity.more() || !socket.recv(&message, 0)) continue;
+            while (message.more()) socket.recv(&message, 0);
+            if (message.size() < 9) continue;
+
+            char type = static_cast<const char*>(message.data())[0];
+            std::uint64_t position = field(message, 0);
+            std::lock_guard<std::mutex> lock(followersMutex);
+            Follower& follower = followerFor(std::string(static_cast<const char*>(identity.data()), identity.size()));
+            follower.lastHeard = std::chrono::steady_clock::now();
+            if (type == syncMessage && message.size() >= 10) {
+                // A position past the end of this log belongs to another log (or a lost tail)
+                bool hasState = static_cast<const char*>(message.data())[9] != 0;
+                follower.needsSnapshot = !hasState || position > logEnd.load();
+                follower.sent = follower.acked = position;
+            } else if (type == ackMessage) {
+                // An ack from a follower this primary does not know yet (it restarted) works as a sync
+                if (follower.sent < position) follower.sent = position;
+                follower.acked = std::max(follower.acked, position);
+                if (position > logEnd.load()) follower.needsSnapshot = true;
+            }
+        }
+    }
+
+    // Freezes the shards and sends the snapshot in parts. The log position is taken first, as
+    // in SnapshotThread::take, so the records after it are all streamed afterwards.
+    void sendSnapshot(zmq::socket_t& socket, Follower& follower) {
+        using namespace replicationformat;
+        std::uint64_t position = log.position();
+        std::vector<UserTable::Columns> tables = shards.freeze();
+        UsernameAllocator::State usernames = shards.usernames().state();
+        log.waitUntilWritten(position);
+
+        std::FILE* file = std::tmpfile();
+        bool ok = file != nullptr && writeSnapshot(file, tables, channels, usernames, position);
+        tables.clear();
+        std::string data;
+        if (ok) {
+            std::fseek(file, 0, SEEK_END);
+            data.resize(static_cast<std::size_t>(std::ftell(file)));
+            std::fseek(file, 0, SEEK_SET);
+            ok = std::fread(&data[0], 1, data.size(), file) == data.size();
+        }
+        if (file != nullptr) std::fclose(file);
+        if (!ok) {
+            std::cerr << "[Replicatie] Snapshot voor volger maken mislukt" << std::endl;
+            return;
+        }
+
+        for (std::size_t offset = 0; offset < data.size(); offset += snapshotChunkSize) {
+            std::size_t size = std::min(snapshotChunkSize, data.size() - offset);
+            send(socket, follower.identity, encode(snapshotMessage, {position, data.size(), offset}, data.data() + offset, size));
+        }
+        bytesSent.fetch_add(data.size(), std::memory_order_relaxed);
+        snapshotsSent.fetch_add(1, std::memory_order_relaxed);
+        follower.needsSnapshot = false;
+        follower.sent = follower.acked = position;
+        follower.lastSent = std::chrono::steady_clock::now();
+        std::cout << "[Replicatie] Snapshot van " << data.size() / 1024 << " KB naar volger gestuurd" << std::endl;
+    }
+
+    // Sends the log from the follower's position on, as far as the window allows
+    void sendRecords(zmq::socket_t& socket, std::ifstream& in, Follower& follower, std::uint64_t end, std::string& buffer) {
+        using namespace replicationformat;
+        while (follower.sent < end && follower.sent - follower.acked < window) {
+            std::size_t size = static_cast<std::size_t>(std::min<std::uint64_t>(chunkSize, end - follower.sent));
+            buffer.resize(size);
+            in.clear();
+            in.seekg(static_cast<std::streamoff>(follower.sent));
+            in.read(&buffer[0], static_cast<std::streamsize>(size));
+            size = static_cast<std::size_t>(in.gcount());
+            if (size == 0) return;
+            send(socket, follower.identity, encode(recordsMessage, {follower.sent, end, wallClockMillis()}, buffer.data(), size));
+            follower.sent += size;
+            follower.lastSent = std::chrono::steady_clock::now();
+            bytesSent.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+
+    void run() {
+        using namespace replicationformat;
+        zmq::socket_t socket{context, zmq::socket_type::router};
+        socket.setsockopt(ZMQ_LINGER, 0);
+        socket.bind(endpoint.c_str());
+        std::ifstream in(logPath, std::ios::binary);
+        std::string buffer;
+
+        while (!stopping.load()) {
+            zmq::pollitem_t items[] = {{ static_cast<void*>(socket), 0, ZMQ_POLLIN, 0 }};
+            zmq::poll(items, 1, pollInterval);
+            receive(socket);
+
+            std::uint64_t end = log.writtenPosition();
+            logEnd.store(end);
+            if (!in.is_open()) in.open(logPath, std::ios::binary);
+            auto now = std::chrono::steady_clock::now();
+
+            std::lock_guard<std::mutex> lock(followersMutex);
+            for (Follower& follower : followers) {
+                if (follower.needsSnapshot) sendSnapshot(socket, follower);
+                sendRecords(socket, in, follower, end, buffer);
+                if (now - follower.lastSent >= heartbeatInterval) {
+                    send(socket, follower.identity, encode(recordsMessage, {follower.sent, end, wallClockMillis()}));
+                    follower.lastSent = now;
+                }
+            }
+            auto gone = std::remove_if(followers.begin(), followers.end(), [&](const Follower& follower) {
+                return now - follower.lastHeard >= followerTimeout;
+            });
+            if (gone != followers.end()) std::cout << "[Replicatie] Volger verdwenen" << std::endl;
+            followers.erase(gone, followers.end());
+        }
+    }
+
+    void printStats(std::ostream& out, double seconds) {
+        std::uint64_t sent = bytesSent.load(std::memory_order_relaxed);
+        std::uint64_t end = logEnd.load();
+        out << "  [replicatie] primary op " << endpoint << ", " << std::fixed << std::setprecision(1)
+            << (seconds > 0 ? (sent - lastBytesSent) / seconds / 1024.0 : 0.0) << " KB/s verstuurd, "
+            << snapshotsSent.load() << " snapshots";
+        lastBytesSent = sent;
+        std::lock_guard<std::mutex> lock(followersMutex);
+        auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < followers.size(); ++i) {
+            const Follower& follower = followers[i];
+            out << "; volger " << i + 1 << ": " << (end > follower.acked ? end - follower.acked : 0) / 1024.0
+                << " KB achter, laatste ack "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(now - follower.lastHeard).count() << " ms geleden";
+        }
+        if (followers.empty()) out << "; geen volgers";
+        out << std::endl;
+    }
+
+public:
+    // Serves the log at logPath, written by writeAheadLog, on endpoint (e.g. tcp://*:24043)
+    ReplicationSource(zmq::context_t& zmqContext, const std::string& bindEndpoint, const std::string& writeAheadLogPath,
+                      WriteAheadLog& writeAheadLog, UserShards& userShards, const ChannelRegistry& channelRegistry,
+                      ServerStats& serverStats)
+        : context(zmqContext), endpoint(bindEndpoint), logPath(writeAheadLogPath), log(writeAheadLog),
+          shards(userShards), channels(channelRegistry), stats(serverStats) {
+        statsSection = stats.addSection([this](std::ostream& out, double seconds) {
+            printStats(out, seconds);
+        });
+    }
+
+    ReplicationSource(const ReplicationSource&) = delete;
+    ReplicationSource& operator=(const ReplicationSource&) = delete;
+
+    ~ReplicationSource() {
+        stopping.store(true);
+        if (thread.joinable()) thread.join();
+        stats.removeSection(statsSection);
+    }
+
+    void start() {
+        thread = std::thread(&ReplicationSource::run, this);
+        std::cout << "[Replicatie] Primary: log wordt aangeboden op " << endpoint << std::endl;
+    }
+};
+
+// Follower side: applies the log of a primary to the shards until the primary has been
+// silent for takeoverAfter, then returns so the caller can take over. It runs on the
+// thread that calls run(), which is the only writer of the shards meanwhile.
+//
+// With a snapshot path the follower writes its own snapshot (in primary log positions)
+// every snapshotInterval and after it received one, so a restart only needs the log after it.
+class ReplicationFollower {
+private:
+    static constexpr std::chrono::milliseconds receiveTimeout{100};
+    static constexpr std::chrono::seconds resyncAfter{1}; // silence after which the follower asks again
+
+    zmq::context_t& context;
+    std::string endpoint;
+    UserShards& shards;
+    ChannelRegistry& channels;
+    std::string snapshotPath;
+    std::chrono::seconds snapshotInterval;
+    std::chrono::seconds takeoverAfter;
+    ServerStats& stats;
+    std::size_t statsSection;
+
+    std::uint64_t applied;     // log position of the primary the shards have
+    bool hasState;             // false until a snapshot or the log from position 0 was applied
+    std::string pending;       // log bytes after applied that do not make a whole record yet
+    std::string snapshot;      // parts of a snapshot received so far
+    std::uint64_t snapshotPosition = 0;
+
+    std::thread snapshotWriter;
+    std::atomic<bool> writingSnapshot{false};
+
+    std::atomic<std::uint64_t> appliedPosition{0};
+    std::atomic<std::uint64_t> primaryEnd{0};
+    std::atomic<std::uint64_t> lagMillis{0};
+    std::atomic<std::uint64_t> recordsApplied{0};
+    std::atomic<std::uint64_t> snapshotsLoaded{0};
+    std::uint64_t lastRecords = 0; // only used by the reporter
+
+    void sendSync(zmq::socket_t& socket) {
+        pending.clear();
+        snapshot.clear();
+        std::string message = replicationformat::encode(replicationformat::syncMessage, {applied});
+        message.push_back(hasState ? 1 : 0);
+        socket.send(message.data(), message.size(), 0);
+    }
+
+    void sendAck(zmq::socket_t& socket) {
+        std::string message = replicationformat::encode(replicationformat::ackMessage, {applied});
+        socket.send(message.data(), message.size(), 0);
+    }
+
+    // Writes a snapshot of the shards on a thread of its own; they are frozen here, between two records
+    void takeSnapshot() {
+        if (snapshotPath.empty() || writingSnapshot.load()) return;
+        if (snapshotWriter.joinable()) snapshotWriter.join();
+        writingSnapshot.store(true);
+        std::vector<UserTable::Columns> tables = shards.freeze();
+        snapshotWriter = std::thread([this, tables = std::move(tables), usernames = shards.usernames().state(),
+                                      position = applied] {
+            saveSnapshot(snapshotPath, tables, channels, usernames, position);
+            writingSnapshot.store(false);
+        });
+    }
+
+    // False when the message does not fit the stream and the follower has to sync again
+    bool handleRecords(const zmq::message_t& message) {
+        using namespace replicationformat;
+        std::uint64_t start = field(message, 0);
+        primaryEnd.store(field(message, 1));
+        std::uint64_t sentAt = field(message, 2);
+        const char* bytes = static_cast<const char*>(message.data()) + headerSize;
+        std::size_t size = message.size() - headerSize;
+
+        std::uint64_t expected = applied + pending.size();
+        if (start > expected) return false;
+        if (start + size > expected) pending.append(bytes + (expected - start), static_cast<std::size_t>(start + size - expected));
+
+        std::size_t pos = 0;
+        Mutation mutation;
+        bool known = true;
+        while (std::size_t recordSize = mutationformat::decode(pending.data() + pos, pending.size() - pos, mutation)) {
+            // A record for a registration the follower does not have: its state is missing records
+            if (!shards.apply(mutation)) {
+                std::cerr << "[Replicatie] Record op positie " << applied + pos << " voor onbekende gebruiker "
+                          << mutation.name << ", vraag snapshot" << std::endl;
+                known = false;
+                break;
+            }
+            pos += recordSize;
+            recordsApplied.fetch_add(1, std::memory_order_relaxed);
+        }
+        pending.erase(0, pos);
+        applied += pos;
+        appliedPosition.store(applied);
+        if (!known) {
+            hasState = false;
+            return false;
+        }
+
+        // A whole record that does not decode is damaged: start over from a snapshot
+        if (pending.size() >= mutationformat::headerSize
+            && mutationformat::getInt(pending.data(), 4) <= pending.size() - mutationformat::headerSize) {
+            std::cerr << "[Replicatie] Beschadigd record op positie " << applied << ", vraag snapshot" << std::endl;
+            hasState = false;
+            return false;
+        }
+        std::uint64_t now = wallClockMillis();
+        lagMillis.store(applied >= primaryEnd.load() || size == 0 ? 0 : (now > sentAt ? now - sentAt : 0));
+        return true;
+    }
+
+    bool handleSnapshot(const zmq::message_t& message) {
+        using namespace replicationformat;
+        std::uint64_t position = field(message, 0);
+        std::uint64_t total = field(message, 1);
+        std::uint64_t offset = field(message, 2);
+        if (offset == 0) {
+            snapshot.clear();
+            snapshot.reserve(static_cast<std::size_t>(total));
+            snapshotPosition = position;
+        }
+        if (offset != snapshot.size() || position != snapshotPosition) return false;
+        snapshot.append(static_cast<const char*>(message.data()) + headerSize, message.size() - headerSize);
+        if (snapshot.size() < total) return true;
+
+        SnapshotInfo info;
+        bool ok = loadSnapshot(snapshot.data(), snapshot.size(), "replicatie snapshot", shards, channels, info);
+        snapshot.clear();
+        snapshot.shrink_to_fit();
+        if (!ok) return false;
+        shards.evictIfFull();
+        applied = position;
+        appliedPosition.store(applied);
+        hasState = true;
+        pending.clear();
+        snapshotsLoaded.fetch_add(1, std::memory_order_relaxed);
+        std::cout << "[Replicatie] Snapshot met " << info.users << " gebruikers geladen" << std::endl;
+        takeSnapshot();
+        return true;
+    }
+
+    void printStats(std::ostream& out, double seconds) {
+        std::uint64_t records = recordsApplied.load(std::memory_order_relaxed);
+        std::uint64_t position = appliedPosition.load();
+        std::uint64_t end = primaryEnd.load();
+        out << "  [replicatie] volger van " << endpoint << ": positie " << position << ", "
+            << std::fixed << std::setprecision(1) << (end > position ? end - position : 0) / 1024.0
+            << " KB achter (" << lagMillis.load() << " ms), " << std::setprecision(0)
+            << (seconds > 0 ? (records - lastRecords) / seconds : 0.0) << " records/s, "
+            << snapshotsLoaded.load() << " snapshots geladen" << std::endl;
+        lastRecords = records;
+    }
+
+public:
+    // position and state are those of the shards now: a local snapshot, or nothing
+    ReplicationFollower(zmq::context_t& zmqContext, const std::string& primaryEndpoint, UserShards& userShards,
+                        ChannelRegistry& channelRegistry, const std::string& localSnapshotPath,
+                        std::chrono::seconds localSnapshotInterval, std::chrono::seconds silenceBeforeTakeover,
+                        std::uint64_t position, bool withState, ServerStats& serverStats)
+        : context(zmqContext), endpoint(primaryEndpoint), shards(userShards), channels(channelRegistry),
+          snapshotPath(localSnapshotPath), snapshotInterval(localSnapshotInterval),
+          takeoverAfter(silenceBeforeTakeover), stats(serverStats), applied(position), hasState(withState) {
+        appliedPosition.store(applied);
+        statsSection = stats.addSection([this](std::ostream& out, double seconds) {
+            printStats(out, seconds);
+        });
+    }
+
+    ReplicationFollower(const ReplicationFollower&) = delete;
+    ReplicationFollower& operator=(const ReplicationFollower&) = delete;
+
+    ~ReplicationFollower() {
+        if (snapshotWriter.joinable()) snapshotWriter.join();
+        stats.removeSection(statsSection);
+    }
+
+    // Follows the primary until it is silent for takeoverAfter (never when that is 0)
+    void run() {
+        using namespace replicationformat;
+        zmq::socket_t socket{context, zmq::socket_type::dealer};
+        socket.setsockopt(ZMQ_LINGER, 0);
+        socket.setsockopt(ZMQ_RCVTIMEO, static_cast<int>(receiveTimeout.count()));
+        socket.connect(endpoint.c_str());
+        std::cout << "[Replicatie] Volgt " << endpoint << " vanaf positie " << applied << std::endl;
+        sendSync(socket);
+
+        auto lastHeard = std::chrono::steady_clock::now();
+        auto lastSync = lastHeard; // also the last ack
+        auto lastSnapshot = lastHeard;
+        while (true) {
+            zmq::message_t message;
+            auto now = std::chrono::steady_clock::now();
+            if (socket.recv(&message, 0)) {
+                now = std::chrono::steady_clock::now();
+                lastHeard = now;
+                char type = message.size() >= headerSize ? static_cast<const char*>(message.data())[0] : 0;
+                bool inStream = true;
+                if (type == recordsMessage) {
+                    inStream = handleRecords(message);
+                    if (inStream && message.size() > headerSize) sendAck(socket);
+                } else if (type == snapshotMessage) {
+                    inStream = handleSnapshot(message);
+                    if (inStream && snapshot.empty()) sendAck(socket);
+                }
+                if (!inStream && now - lastSync >= resyncAfter / 10) {
+                    sendSync(socket);
+                    lastSync = now;
+                }
+            } else if (now - lastHeard >= resyncAfter && now - lastSync >= resyncAfter) {
+                // The primary may have restarted without knowing this follower
+                sendSync(socket);
+                lastSync = now;
+            }
+            if (takeoverAfter.count() > 0 && now - lastHeard >= takeoverAfter) break;
+            // An ack now and then also keeps the primary from dropping an idle follower
+            if (now - lastSync >= resyncAfter && snapshot.empty()) {
+                sendAck(socket);
+                lastSync = now;
+            }
+            if (snapshotInterval.count() > 0 && hasState && now - lastSnapshot >= snapshotInterval) {
+                takeSnapshot();
+                lastSnapshot = now;
+            }
+        }
+        if (snapshotWriter.joinable()) snapshotWriter.join();
+        std::cout << "[Replicatie] Primary zwijgt al " << takeoverAfter.count() << "s, volger neemt over op positie "
+                  << applied << std::endl;
+    }
+
+    std::uint64_t position() const {
+        return applied;
+    }
+};
+
+#endif // REPLICATION_H
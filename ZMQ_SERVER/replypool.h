@@ -0,0 +1,115 @@
+#ifndef REPLYPOOL_H
+#define REPLYPOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <zmq.hpp>
+
+// Fixed-size reply buffers that are handed to libzmq without copying.
+// encode() formats a reply straight into a free buffer and wraps it in a zmq::message_t
+// whose free callback puts the buffer back. libzmq calls that callback from whichever
+// thread drops the last reference (often its I/O thread), so the free list is a
+// lock-free stack of buffer indexes; the index is tagged with a counter against ABA.
+//
+// Replies that fit in a zmq message's inline storage are written there directly, and
+// replies larger than a buffer (or arriving when the pool is empty) fall back to the heap.
+class ReplyPool {
+private:
+    static const std::uint32_t none = 0xFFFFFFFFu;
+
+    std::size_t bufferSize;
+    std::uint32_t bufferCount;
+    std::unique_ptr<char[]> storage;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> next; // free list links
+    std::atomic<std::uint64_t> head;                     // tag << 32 | index of the first free buffer
+
+    // Writes into a plain buffer, for Schema::encode
+    struct BufferWriter {
+        char* pos;
+        void append(const char* data, std::size_t size) {
+            std::memcpy(pos, data, size);
+            pos += size;
+        }
+        void push_back(char c) {
+            *pos++ = c;
+        }
+    };
+
+    char* acquire() {
+        std::uint64_t current = head.load(std::memory_order_acquire);
+        while (true) {
+            std::uint32_t index = static_cast<std::uint32_t>(current);
+            if (index == none) return nullptr;
+            std::uint64_t tag = (current >> 32) + 1;
+            std::uint64_t replacement = (tag << 32) | next[index].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(current, replacement, std::memory_order_acquire, std::memory_order_acquire)) {
+                return storage.get() + static_cast<std::size_t>(index) * bufferSize;
+            }
+        }
+    }
+
+    void release(char* buffer) {
+        std::uint32_t index = static_cast<std::uint32_t>((buffer - storage.get()) / bufferSize);
+        std::uint64_t current = head.load(std::memory_order_relaxed);
+        while (true) {
+            next[index].store(static_cast<std::uint32_t>(current), std::memory_order_relaxed);
+            std::uint64_t tag = (current >> 32) + 1;
+            if (head.compare_exchange_weak(current, (tag << 32) | index, std::memory_order_release, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    static void releaseBuffer(void* data, void* hint) {
+        static_cast<ReplyPool*>(hint)->release(static_cast<char*>(data));
+    }
+
+    static void deleteBuffer(void* data, void*) {
+        delete[] static_cast<char*>(data);
+    }
+
+public:
+    // Payloads up to this size are stored inside the zmq message itself (libzmq's VSM)
+    static const std::size_t inlineSize = 33;
+
+    explicit ReplyPool(std::size_t size = 1024, std::uint32_t count = 2048)
+        : bufferSize(size), bufferCount(count),
+        storage(new char[size * count]), next(new std::atomic<std::uint32_t>[count]), head(0)
+    {
+        for (std::uint32_t i = 0; i < count; ++i) {
+            next[i].store(i + 1 < count ? i + 1 : none, std::memory_order_relaxed);
+        }
+        head.store(count > 0 ? 0 : none);
+    }
+
+    ReplyPool(const ReplyPool&) = delete;
+    ReplyPool& operator=(const ReplyPool&) = delete;
+
+    // Builds a Message (see benthernet/messages.hpp) from its fields
+    template <typename Message, typename... Args>
+    zmq::message_t encode(const Args&... args) {
+        std::size_t size = Message::encodedSize(args...);
+
+        if (size <= inlineSize) {
+            zmq::message_t reply(size);
+            BufferWriter writer{reply.data<char>()};
+            Message::encode(writer, args...);
+            return reply;
+        }
+
+        char* buffer = size <= bufferSize ? acquire() : nullptr;
+        zmq::free_fn* freeFn = releaseBuffer;
+        if (buffer == nullptr) {
+            buffer = new char[size];
+            freeFn = deleteBuffer;
+        }
+        BufferWriter writer{buffer};
+        Message::encode(writer, args...);
+        return zmq::message_t(buffer, size, freeFn, this);
+    }
+};
+
+#endif // REPLYPOOL_H
@@ -0,0 +1,110 @@
+#ifndef REQUESTARENA_H
+#define REQUESTARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+
+// Bump-pointer memory for the scratch data of one request.
+// The handlers allocate their temporary strings and vectors from here through
+// std::pmr containers; nothing is freed one by one, reset() drops everything at once
+// after the message is handled. A request that needs more than the arena holds spills
+// to the upstream resource (the normal heap); those blocks are also released by reset().
+//
+// Only the owning handler thread allocates. The counters are atomics so the stats
+// reporter can read them from its own thread.
+class RequestArena : public std::pmr::memory_resource {
+private:
+    // Header in front of every spilled block, so reset() can hand it back upstream
+    struct Spill {
+        Spill* next;
+        std::size_t bytes;     // size of the whole upstream block
+        std::size_t alignment;
+    };
+
+    std::unique_ptr<std::byte[]> buffer;
+    std::size_t capacity;
+    std::size_t used = 0;
+    std::size_t requestBytes = 0; // everything handed out for the current request, spills included
+    Spill* spills = nullptr;
+    std::pmr::memory_resource* upstream;
+
+    static std::size_t alignUp(std::size_t value, std::size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    void* spill(std::size_t bytes, std::size_t alignment) {
+        if (alignment < alignof(Spill)) alignment = alignof(Spill);
+        std::size_t offset = alignUp(sizeof(Spill), alignment);
+        std::byte* block = static_cast<std::byte*>(upstream->allocate(offset + bytes, alignment));
+        spills = new (block) Spill{spills, offset + bytes, alignment};
+        spilledBytes.fetch_add(bytes, std::memory_order_relaxed);
+        return block + offset;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        requestBytes += bytes;
+        std::size_t start = alignUp(reinterpret_cast<std::uintptr_t>(buffer.get()) + used, alignment)
+                            - reinterpret_cast<std::uintptr_t>(buffer.get());
+        if (start + bytes > capacity) return spill(bytes, alignment);
+        used = start + bytes;
+        return buffer.get() + start;
+    }
+
+    // Memory is only given back by reset()
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> spilledRequests{0}; // requests that did not fit in the arena
+    std::atomic<std::uint64_t> spilledBytes{0};
+    std::atomic<std::size_t> highWater{0};         // largest request so far, in bytes
+    std::atomic<std::size_t> intervalPeak{0};      // largest request since the reporter last looked
+
+    explicit RequestArena(std::size_t size = 16 * 1024,
+                          std::pmr::memory_resource* upstreamResource = std::pmr::new_delete_resource())
+        : buffer(new std::byte[size]), capacity(size), upstream(upstreamResource) {}
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    ~RequestArena() override {
+        reset();
+    }
+
+    std::size_t size() const {
+        return capacity;
+    }
+
+    // Ends the current request: updates the counters and makes the whole arena free again
+    void reset() {
+        requests.fetch_add(1, std::memory_order_relaxed);
+        if (requestBytes == 0) return;
+
+        if (spills != nullptr) spilledRequests.fetch_add(1, std::memory_order_relaxed);
+        if (requestBytes > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(requestBytes, std::memory_order_relaxed);
+        }
+        std::size_t peak = intervalPeak.load(std::memory_order_relaxed);
+        while (requestBytes > peak && !intervalPeak.compare_exchange_weak(peak, requestBytes, std::memory_order_relaxed)) {
+        }
+
+        while (spills != nullptr) {
+            Spill* block = spills;
+            spills = block->next;
+            upstream->deallocate(block, block->bytes, block->alignment);
+        }
+        used = 0;
+        requestBytes = 0;
+    }
+};
+
+#endif // REQUESTARENA_H
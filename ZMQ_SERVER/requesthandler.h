@@ -0,0 +1,317 @@
+#ifndef REQUESTHANDLER_H
+#define REQUESTHANDLER_H
+
+#include <string>
+#include <string_view>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <charconv>
+#include <vector>
+#include <memory_resource>
+#include "usermanager.h"
+#include "dispatcher.h"
+#include "entropypool.h"
+#include "replypool.h"
+#include "requestarena.h"
+#include "generatedname.h"
+#include "serverstats.h"
+#include <benthernet/codec.hpp>
+
+using namespace benthernet;
+
+// Builds the password in the given resource, normally the request arena. The characters come
+// from the entropy pool of the calling thread, each one equally likely.
+inline std::pmr::string generateRandomPassword(int length, std::pmr::memory_resource* resource) {
+    static const std::string_view chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789!@#$%^&*";
+    EntropyPool& entropy = EntropyPool::local();
+    std::pmr::string password(resource);
+    password.resize(static_cast<std::size_t>(length));
+    for (char& c : password) c = chars[entropy.below(chars.size())];
+    return password;
+}
+
+// Handles one client request and hands every reply to the given publish callback.
+// The same handler runs inline on the receive thread or on a worker thread; it only
+// touches the UserManager shard that owns the client name of the request.
+// Every service registers itself in the dispatcher under its topic.
+// Scratch strings of a request come from the arena, which handle() resets afterwards.
+class RequestHandler {
+private:
+    static const std::size_t sessionBatch = 256; // expired sessions logged out per expireSessions() call
+    static const int maxPasswordLength = 1024;   // longer requests get this length
+
+    UserShards& userShards;
+    std::size_t shard; // the shard whose sessions this handler expires
+    Dispatcher dispatcher;
+    ReplyPool replies; // Buffers of the replies this handler sends, must outlive them
+    RequestArena arena;
+    ServerStats& stats;
+    std::size_t statsSection;
+    std::vector<std::string> games = {
+        "The Legend of Zelda: Breath of the Wild", "Minecraft", "Among Us", "Fortnite",
+        "Overwatch", "Celeste", "Hades", "Stardew Valley", "Dark Souls", "GTA V",
+        "COD Zombies", "Warzone", "Pacman", "Tetris", "League of Legends", "SOGGY BISCUIT"
+    };
+
+    template <void (RequestHandler::*Method)(std::string_view, const Publish&)>
+    void registerService(std::string_view topic) {
+        dispatcher.registerHandler(topic, [this](std::string_view message, const Publish& publish) {
+            (this->*Method)(message, publish);
+        });
+    }
+
+    void handleUsername(std::string_view message, const Publish& publish) {
+        UsernameRequest::Fields fields;
+        UsernameRequest::decode(message, fields);
+        std::string_view name = fields[UsernameRequest::name];
+        std::string_view channel = fields[UsernameRequest::channel];
+        if (name.empty() || channel.empty()) {
+            std::cerr << "[Server] Ongeldig username bericht" << std::endl;
+            return;
+        }
+        // The log and the cold store keep names and channels up to this size
+        if (name.size() > mutationformat::maxTextSize || channel.size() > mutationformat::maxTextSize) {
+            std::cerr << "[Server] Naam of kanaal te lang (" << name.size() << "/" << channel.size() << " bytes)" << std::endl;
+            return;
+        }
+
+        UserManager& userManager = userShards.shardForName(name);
+        GeneratedName generatedUsername = userShards.usernames().allocate();
+        userManager.registerUser(name, channel, generatedUsername);
+
+        zmq::message_t reply = replies.encode<UsernameReply>(name, channel, concat(registeredAsText, generatedUsername.text()));
+        std::cout << "Verstuur bericht naar client: " << view(reply) << std::endl;
+        publish(std::move(reply));
+    }
+
+    void handlePassword(std::string_view message, const Publish& publish) {
+        PasswordRequest::Fields fields;
+        PasswordRequest::decode(message, fields);
+        std::string_view name = fields[PasswordRequest::name];
+        std::string_view lengthStr = fields[PasswordRequest::length];
+        if (name.empty()) {
+            std::cerr << "[Server] Ongeldig password bericht" << std::endl;
+            return;
+        }
+        int pwLength = 0;
+        std::from_chars(lengthStr.data(), lengthStr.data() + lengthStr.size(), pwLength);
+        if (pwLength <= 0) pwLength = 8;
+        if (pwLength > maxPasswordLength) pwLength = maxPasswordLength;
+
+        UserManager& userManager = userShards.shardForName(name);
+        std::pmr::string genPassword = generateRandomPassword(pwLength, &arena);
+        if (!userManager.setPasswordOfName(name, genPassword)) {
+            std::cerr << "[Server] Geen geregistreerde gebruiker gevonden voor wachtwoordaanvraag: " << name << std::endl;
+            // Send an error reply to client
+            publish(replies.encode<PasswordError>(name, "Fout: Gebruiker niet gevonden. Registreer eerst."));
+            return;
+        }
+
+        zmq::message_t reply = replies.encode<PasswordReply>(name, lengthStr, concat(passwordIsText, genPassword));
+        std::cout << "Verstuur wachtwoord naar client: " << view(reply) << std::endl;
+        publish(std::move(reply));
+    }
+
+    void handleLogin(std::string_view message, const Publish& publish) {
+        LoginRequest::Fields fields;
+        LoginRequest::decode(message, fields);
+        std::string_view name = fields[LoginRequest::name];
+        std::string_view providedPassword = fields[LoginRequest::password];
+        if (name.empty()) {
+            std::cerr << "[Server] Ongeldig login bericht" << std::endl;
+            return;
+        }
+
+        UserManager& userManager = userShards.shardForName(name);
+        switch (userManager.logIn(name, providedPassword)) {
+        case LoginResult::unknownUser:
+            publish(replies.encode<LoginReply>(name, "Gebruiker niet gevonden"));
+            break;
+        case LoginResult::wrongPassword:
+            publish(replies.encode<LoginReply>(name, "Wachtwoord ongeldig"));
+            break;
+        case LoginResult::loggedIn:
+            publish(replies.encode<LoginReply>(name, loginSucceededText));
+            break;
+        }
+    }
+
+    void handleLogout(std::string_view message, const Publish& publish) {
+        LogoutRequest::Fields fields;
+        LogoutRequest::decode(message, fields);
+        std::string_view name = fields[LogoutRequest::name];
+        // The worker was chosen by the name before a '|', and only owns the shard of that name
+        if (clientNameOf(name) != name) {
+            std::cerr << "[Server] Ongeldig logout bericht" << std::endl;
+            return;
+        }
+
+        UserManager& userManager = userShards.shardForName(name);
+        GeneratedName loggedOut;
+        if (userManager.logOut(name, loggedOut)) {
+            std::cout << "[Server] User " << loggedOut << " logged out." << std::endl;
+            publish(replies.encode<LogoutReply>(name, "Uitgelogd"));
+        } else {
+            std::cerr << "[Server] Could not find user to log out: " << name << std::endl;
+            publish(replies.encode<LogoutReply>(name, "Fout bij uitloggen: gebruiker niet gevonden"));
+        }
+    }
+
+    void handleHeartbeat(std::string_view message, const Publish& publish) {
+        HeartbeatRequest::Fields fields;
+        HeartbeatRequest::decode(message, fields);
+        std::string_view name = fields[HeartbeatRequest::name];
+        if (clientNameOf(name) != name) {
+            std::cerr << "[Server] Ongeldig heartbeat bericht" << std::endl;
+            return;
+        }
+
+        // Only a client whose session is gone hears back, the others send these every few seconds
+        if (!userShards.shardForName(name).heartbeat(name)) {
+            publish(replies.encode<HeartbeatReply>(name, sessionExpiredText));
+        }
+    }
+
+    void handleGame(std::string_view message, const Publish& publish) {
+        GameRequest::Fields fields;
+        GameRequest::decode(message, fields);
+        std::string_view username_and_channel = fields[GameRequest::user]; // This is the original name|channel from client
+
+        const std::string& randomGame = games[EntropyPool::local().below(games.size())];
+
+        zmq::message_t reply = replies.encode<GameReply>(username_and_channel, concat(randomGameText, randomGame));
+        std::cout << "Verstuur random game naar client: " << view(reply) << std::endl;
+        publish(std::move(reply));
+    }
+
+    void handleClients(std::string_view, const Publish& publish) {
+        std::pmr::vector<std::pmr::string> loggedInUsers(&arena);
+        userShards.getLoggedInUsers(loggedInUsers);
+        std::pmr::string clientList(&arena);
+        if (loggedInUsers.empty()) {
+            clientList += "Geen clients momenteel ingelogd.";
+        } else {
+            // Size the list up front, the arena does not reuse the buffers a growing string leaves behind
+            std::size_t listSize = 19;
+            for (const auto& user : loggedInUsers) listSize += user.size() + 2;
+            clientList.reserve(listSize);
+            clientList += "Ingelogde clients: ";
+            for (size_t i = 0; i < loggedInUsers.size(); ++i) {
+                clientList += loggedInUsers[i];
+                if (i < loggedInUsers.size() - 1) {
+                    clientList += ", ";
+                }
+            }
+        }
+        zmq::message_t reply = replies.encode<ClientsReply>(clientList);
+        std::cout << "[Server] Sending client list: " << view(reply) << std::endl;
+        publish(std::move(reply));
+    }
+
+    void handleChat(std::string_view message, const Publish& publish) {
+        ChatRequest::Fields fields;
+        ChatRequest::decode(message, fields);
+        std::string_view channel = fields[ChatRequest::channel];
+        std::string_view senderUsername = fields[ChatRequest::sender];
+        std::string_view chatMessageText = fields[ChatRequest::text];
+
+        if (channel.empty() || senderUsername.empty() || chatMessageText.empty()) {
+            std::cerr << "[Server] Ongeldig chat bericht: " << message << std::endl;
+            // Optionally send an error back to the sender
+            return;
+        }
+
+        if (ChangeFeed* feed = userShards.changeFeed()) feed->publish(ChangeEvent::chatPosted, senderUsername, channel, chatMessageText);
+
+        // The server re-publishes the chat message to all subscribers of that channel
+        zmq::message_t chatBroadcast = replies.encode<ChatBroadcast>(channel, senderUsername, chatMessageText);
+        std::cout << "[Server] Broadcasting chat: " << view(chatBroadcast) << std::endl;
+        publish(std::move(chatBroadcast));
+    }
+
+    void printArenaStats(std::ostream& out, const std::string& name,
+                         std::uint64_t& lastRequests, std::uint64_t& lastSpilled) {
+        std::uint64_t requests = arena.requests.load(std::memory_order_relaxed);
+        std::uint64_t spilled = arena.spilledRequests.load(std::memory_order_relaxed);
+        std::uint64_t count = requests - lastRequests;
+        std::uint64_t spilledCount = spilled - lastSpilled;
+
+        out << "  " << std::left << std::setw(10) << name << std::right
+            << " arena peak " << std::setw(6) << arena.intervalPeak.exchange(0, std::memory_order_relaxed)
+            << " B  high-water " << std::setw(6) << arena.highWater.load(std::memory_order_relaxed)
+            << " / " << arena.size() << " B  spilled " << spilledCount << " of " << count << " requests"
+            << std::endl;
+
+        lastRequests = requests;
+        lastSpilled = spilled;
+    }
+
+    void printSessionStats(std::ostream& out, const std::string& name, double seconds,
+                           std::uint64_t& lastHeartbeats, std::uint64_t& lastExpired) {
+        SessionCounters& counters = userShards.shard(shard).sessionCounters;
+        std::uint64_t heartbeats = counters.heartbeats.load(std::memory_order_relaxed);
+        std::uint64_t expired = counters.expired.load(std::memory_order_relaxed);
+
+        out << "  " << std::left << std::setw(10) << name << std::right
+            << " sessies " << std::setw(8) << counters.sessions.load(std::memory_order_relaxed)
+            << "  heartbeats/s " << std::fixed << std::setprecision(0)
+            << (seconds > 0 ? (heartbeats - lastHeartbeats) / seconds : 0.0)
+            << "  verlopen " << (expired - lastExpired) << std::endl;
+
+        lastHeartbeats = heartbeats;
+        lastExpired = expired;
+    }
+
+public:
+    // How long a loop waits for a request before it expires sessions anyway, in milliseconds
+    static constexpr int idleMillis = 100;
+
+    // name identifies this handler (and its arena) in the statistics. The handler only gets
+    // the requests of names in shardIndex, and expires the sessions of that shard.
+    RequestHandler(UserShards& shards, ServerStats& serverStats, const std::string& name = "handler",
+                   std::size_t shardIndex = 0)
+        : userShards(shards), shard(shardIndex), stats(serverStats)
+    {
+        registerService<&RequestHandler::handleUsername>(UsernameRequest::topic);
+        registerService<&RequestHandler::handlePassword>(PasswordRequest::topic);
+        registerService<&RequestHandler::handleLogin>(LoginRequest::topic);
+        registerService<&RequestHandler::handleLogout>(LogoutRequest::topic);
+        registerService<&RequestHandler::handleHeartbeat>(HeartbeatRequest::topic);
+        registerService<&RequestHandler::handleGame>(GameRequest::topic);
+        registerService<&RequestHandler::handleClients>(ClientsRequest::topic);
+        registerService<&RequestHandler::handleChat>(ChatRequest::topic);
+
+        statsSection = stats.addSection([this, name, lastRequests = std::uint64_t(0), lastSpilled = std::uint64_t(0),
+                                         lastHeartbeats = std::uint64_t(0), lastExpired = std::uint64_t(0)]
+                                        (std::ostream& out, double seconds) mutable {
+            printArenaStats(out, name, lastRequests, lastSpilled);
+            if (userShards.shard(shard).sessionsExpire()) printSessionStats(out, name, seconds, lastHeartbeats, lastExpired);
+        });
+    }
+
+    ~RequestHandler() {
+        stats.removeSection(statsSection);
+    }
+
+    RequestHandler(const RequestHandler&) = delete;
+    RequestHandler& operator=(const RequestHandler&) = delete;
+
+    void handle(std::string_view message, const Publish& publish) {
+        std::cout << "[Server] Received: " << message << std::endl;
+
+        if (!dispatcher.dispatch(message, publish)) {
+            std::cerr << "[Server] Onbekend bericht: " << message << std::endl;
+        }
+        arena.reset();
+    }
+
+    // Logs out a batch of the expired sessions of the shard. The loop running the handler
+    // calls it after every request and when it has waited a while for one; true means more
+    // expired sessions are waiting, so the loop should call it again soon rather than block.
+    bool expireSessions() {
+        return userShards.shard(shard).expireSessions(sessionBatch) == sessionBatch;
+    }
+};
+
+#endif // REQUESTHANDLER_H
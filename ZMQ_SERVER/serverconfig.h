@@ -0,0 +1,91 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include "writeaheadlog.h"
+
+// Command line options of the server, e.g. ZMQ_SERVER --workers 4
+struct ServerConfig {
+    std::size_t workers = 1; // 1 = handle every request on the receive thread, like before
+    bool pipeline = false;   // receive, handle and publish on three threads connected by rings
+    int statsInterval = 5;   // seconds between statistics reports, 0 = no reports
+    std::string walPath;     // write-ahead log of the user changes, empty = users only live in memory
+    SyncMode walSync = SyncMode::interval;
+    std::chrono::milliseconds walSyncInterval{100};
+    bool compactWal = false; // fold the whole log into the snapshot at startup and start a new log
+    std::string snapshotPath; // snapshot of the users, loaded before the log is replayed
+    int snapshotInterval = 300; // seconds between background snapshots, 0 = only at startup
+    std::string coldStorePath; // directory for the users evicted from memory, empty = keep every user in memory
+    std::size_t hotUsers = 1000000; // registrations kept in memory when there is a cold store
+    int sessionTimeout = 60; // seconds without a heartbeat before a logged in client is logged out, 0 = never
+    std::string replicateEndpoint; // primary: serve the log to followers here (needs --wal), e.g. tcp://*:24043
+    std::string followEndpoint;    // follower: apply the log of the primary there, e.g. tcp://localhost:24043
+    int takeoverAfter = 3;         // seconds the primary may be silent before the follower takes over, 0 = never
+    std::string changesEndpoint;   // change events for consumers here, e.g. tcp://*:24044, empty = no events
+    std::size_t changeBacklog = 1000000; // events kept for consumers that resume
+};
+
+inline ServerConfig parseServerArguments(int argc, char* argv[]) {
+    ServerConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc) {
+            int workers = std::atoi(argv[++i]);
+            config.workers = workers > 0 ? static_cast<std::size_t>(workers) : 1;
+        } else if (arg == "--pipeline") {
+            config.pipeline = true;
+        } else if (arg == "--stats-interval" && i + 1 < argc) {
+            int seconds = std::atoi(argv[++i]);
+            config.statsInterval = seconds > 0 ? seconds : 0;
+        } else if (arg == "--wal" && i + 1 < argc) {
+            config.walPath = argv[++i];
+        } else if (arg == "--compact-wal") {
+            config.compactWal = true;
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            config.snapshotPath = argv[++i];
+        } else if (arg == "--snapshot-interval" && i + 1 < argc) {
+            int seconds = std::atoi(argv[++i]);
+            config.snapshotInterval = seconds > 0 ? seconds : 0;
+        } else if (arg == "--cold-store" && i + 1 < argc) {
+            config.coldStorePath = argv[++i];
+        } else if (arg == "--hot-users" && i + 1 < argc) {
+            long long users = std::atoll(argv[++i]);
+            config.hotUsers = users > 0 ? static_cast<std::size_t>(users) : 0;
+        } else if (arg == "--session-timeout" && i + 1 < argc) {
+            int seconds = std::atoi(argv[++i]);
+            config.sessionTimeout = seconds > 0 ? seconds : 0;
+        } else if (arg == "--replicate" && i + 1 < argc) {
+            config.replicateEndpoint = argv[++i];
+        } else if (arg == "--follow" && i + 1 < argc) {
+            config.followEndpoint = argv[++i];
+        } else if (arg == "--takeover-after" && i + 1 < argc) {
+            int seconds = std::atoi(argv[++i]);
+            config.takeoverAfter = seconds > 0 ? seconds : 0;
+        } else if (arg == "--changes" && i + 1 < argc) {
+            config.changesEndpoint = argv[++i];
+        } else if (arg == "--change-backlog" && i + 1 < argc) {
+            long long events = std::atoll(argv[++i]);
+            config.changeBacklog = events > 0 ? static_cast<std::size_t>(events) : 1;
+        } else if (arg == "--wal-sync" && i + 1 < argc) {
+            // batch, off, or milliseconds between fsyncs
+            std::string mode = argv[++i];
+            if (mode == "batch") {
+                config.walSync = SyncMode::batch;
+            } else if (mode == "off") {
+                config.walSync = SyncMode::off;
+            } else {
+                int millis = std::atoi(mode.c_str());
+                config.walSync = millis > 0 ? SyncMode::interval : SyncMode::batch;
+                config.walSyncInterval = std::chrono::milliseconds(millis > 0 ? millis : 0);
+            }
+        } else {
+            std::cerr << "[Server] Onbekende optie genegeerd: " << arg << std::endl;
+        }
+    }
+    return config;
+}
+
+#endif // SERVERCONFIG_H
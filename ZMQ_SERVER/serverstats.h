@@ -0,0 +1,76 @@
+#ifndef SERVERSTATS_H
+#define SERVERSTATS_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+// Collects the statistics of the server components and prints them periodically.
+// Every component adds a section: a callback that prints its counters for the last
+// interval. The callbacks run on the reporter thread, so whatever they read must be
+// safe to read from there (atomics, or data behind the component's own lock).
+class ServerStats {
+public:
+    using Section = std::function<void(std::ostream& out, double seconds)>;
+
+private:
+    mutable std::mutex statsMutex;
+    std::vector<std::pair<std::size_t, Section>> sections; // key = id returned by addSection
+    std::size_t nextId = 0;
+    std::thread reporter;
+
+    void reportLoop(std::chrono::seconds interval) {
+        auto previous = std::chrono::steady_clock::now();
+        while (true) {
+            std::this_thread::sleep_for(interval);
+            auto now = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(now - previous).count();
+            previous = now;
+
+            std::cout << "[Stats] over " << std::fixed << std::setprecision(1) << seconds << "s" << std::endl;
+            print(std::cout, seconds);
+        }
+    }
+
+public:
+    ~ServerStats() {
+        if (reporter.joinable()) reporter.join();
+    }
+
+    // Returns an id for removeSection()
+    std::size_t addSection(Section section) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        sections.emplace_back(nextId, std::move(section));
+        return nextId++;
+    }
+
+    void removeSection(std::size_t id) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for (auto it = sections.begin(); it != sections.end(); ++it) {
+            if (it->first == id) {
+                sections.erase(it);
+                return;
+            }
+        }
+    }
+
+    void print(std::ostream& out, double seconds) const {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for (const auto& section : sections) {
+            section.second(out, seconds);
+        }
+    }
+
+    // Prints every interval on a background thread, forever
+    void start(std::chrono::seconds interval) {
+        reporter = std::thread(&ServerStats::reportLoop, this, interval);
+    }
+};
+
+#endif // SERVERSTATS_H
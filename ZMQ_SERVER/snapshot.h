@@ -0,0 +1,454 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "channelregistry.h"
+#include "usermanager.h"
+#include "writeaheadlog.h"
+#include "serverstats.h"
+
+// Snapshot of every UserManager shard, so a restart loads the users with one sequential
+// read instead of replaying the whole write-ahead log. The tables are written column by
+// column as they are in memory, so loading is mostly memcpy; only the name maps are rebuilt.
+//
+// File layout, little endian (the columns are written in host order, x86 and ARM only):
+//   header  = magic "BNSNAP\0\0" | u32 version | u32 shard count | u64 log offset
+//             | u64 payload size | u32 crc32 of the payload | u32 crc32 of the header before it
+//   payload = u32 channel count | channels (u32 size, text)
+//             | u64 end of the reserved username counters | u64 key | u64 key (version 3 on)
+//             | per shard: table (UserTable::Columns::save)
+// The log offset is the position in the write-ahead log up to which the snapshot contains
+// the changes; only the records after it are replayed.
+namespace snapshotformat {
+
+const char magic[8] = {'B', 'N', 'S', 'N', 'A', 'P', '\0', '\0'};
+const std::uint32_t version = 3; // 2: one name per row instead of one per name, 3: UsernameAllocator state
+const std::size_t headerSize = 40;
+
+// Writes the payload through a buffer, keeping its size and checksum
+class Writer {
+private:
+    std::FILE* file;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+    std::uint64_t written = 0;
+    std::uint32_t crc = 0;
+    bool failed = false;
+
+public:
+    explicit Writer(std::FILE* output) : file(output), buffer(1 << 20) {}
+
+    void flush() {
+        if (used == 0) return;
+        crc = mutationformat::crc32(buffer.data(), used, crc);
+        if (std::fwrite(buffer.data(), 1, used, file) != used) failed = true;
+        written += used;
+        used = 0;
+    }
+
+    void putBytes(const void* data, std::size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            if (used == buffer.size()) flush();
+            std::size_t chunk = std::min(size, buffer.size() - used);
+            std::memcpy(buffer.data() + used, bytes, chunk);
+            used += chunk;
+            bytes += chunk;
+            size -= chunk;
+        }
+    }
+
+    void putInt(std::uint64_t value, std::size_t bytes) {
+        char encoded[8];
+        mutationformat::putInt(encoded, value, bytes);
+        putBytes(encoded, bytes);
+    }
+
+    void putText(std::string_view text) {
+        putInt(text.size(), 4);
+        putBytes(text.data(), text.size());
+    }
+
+    std::uint64_t size() const { return written + used; }
+    std::uint32_t checksum() const { return crc; }
+    bool ok() const { return !failed; }
+};
+
+// Reads the payload from memory. A read past the end returns zeros and makes ok() false.
+class Reader {
+private:
+    const char* pos;
+    const char* end;
+    bool failed = false;
+
+public:
+    Reader(const char* data, std::size_t size) : pos(data), end(data + size) {}
+
+    std::size_t remaining() const {
+        return static_cast<std::size_t>(end - pos);
+    }
+
+    void getBytes(void* out, std::size_t size) {
+        if (size > remaining()) {
+            std::memset(out, 0, size);
+            failed = true;
+            pos = end;
+            return;
+        }
+        std::memcpy(out, pos, size);
+        pos += size;
+    }
+
+    std::uint64_t getInt(std::size_t bytes) {
+        if (bytes > remaining()) {
+            failed = true;
+            pos = end;
+            return 0;
+        }
+        std::uint64_t value = mutationformat::getInt(pos, bytes);
+        pos += bytes;
+        return value;
+    }
+
+    // Text of u32 size followed by its bytes
+    std::string_view getText() {
+        return getText(static_cast<std::size_t>(getInt(4)));
+    }
+
+    std::string_view getText(std::size_t size) {
+        if (size > remaining()) {
+            failed = true;
+            pos = end;
+            return {};
+        }
+        std::string_view text(pos, size);
+        pos += size;
+        return text;
+    }
+
+    bool ok() const { return !failed; }
+};
+
+} // namespace snapshotformat
+
+struct SnapshotInfo {
+    std::uint64_t logOffset = 0;
+    std::size_t users = 0;
+};
+
+// Writes frozen tables of all shards (UserShards::freeze) as a snapshot to file, which is
+// positioned at its start, with the username allocator state read after the freeze.
+// False when a write failed.
+inline bool writeSnapshot(std::FILE* file, const std::vector<UserTable::Columns>& tables,
+                          const ChannelRegistry& channels, const UsernameAllocator::State& usernames,
+                          std::uint64_t logOffset) {
+    using namespace snapshotformat;
+    char header[headerSize] = {};
+    std::fwrite(header, 1, headerSize, file);
+
+    Writer out(file);
+    std::size_t channelCount = channels.size();
+    out.putInt(channelCount, 4);
+    for (std::size_t id = 0; id < channelCount; ++id) out.putText(channels.name(static_cast<ChannelId>(id)));
+    out.putInt(usernames.end, 8);
+    for (std::uint64_t word : usernames.key) out.putInt(word, 8);
+
+    // Read after the tables were frozen, so every channel they use is included
+    for (const UserTable::Columns& table : tables) table.save(out);
+    out.flush();
+
+    char* pos = header;
+    std::memcpy(pos, magic, sizeof(magic));
+    pos = mutationformat::putInt(pos + sizeof(magic), version, 4);
+    pos = mutationformat::putInt(pos, tables.size(), 4);
+    pos = mutationformat::putInt(pos, logOffset, 8);
+    pos = mutationformat::putInt(pos, out.size(), 8);
+    pos = mutationformat::putInt(pos, out.checksum(), 4);
+    mutationformat::putInt(pos, mutationformat::crc32(header, headerSize - 4), 4);
+    std::fseek(file, 0, SEEK_SET);
+    return out.ok() && std::fwrite(header, 1, headerSize, file) == headerSize && std::fflush(file) == 0;
+}
+
+// Writes frozen tables of all shards (UserShards::freeze) to path, replacing an earlier
+// snapshot only once the new one is complete and on disk. The shards keep running meanwhile.
+inline bool saveSnapshot(const std::string& path, const std::vector<UserTable::Columns>& tables,
+                         const ChannelRegistry& channels, const UsernameAllocator::State& usernames,
+                         std::uint64_t logOffset) {
+    std::string temporary = path + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        std::cerr << "[Snapshot] Kan niet schrijven naar " << temporary << std::endl;
+        return false;
+    }
+    bool ok = writeSnapshot(file, tables, channels, usernames, logOffset);
+    syncToDisk(file);
+    std::fclose(file);
+
+    std::error_code error;
+    if (ok) {
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            // Not every platform replaces an existing file on rename
+            std::filesystem::remove(path, error);
+            std::filesystem::rename(temporary, path, error);
+        }
+    }
+    if (!ok || error) {
+        std::cerr << "[Snapshot] Schrijven naar " << path << " mislukt" << std::endl;
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+inline bool saveSnapshot(const std::string& path, UserShards& shards, const ChannelRegistry& channels,
+                         std::uint64_t logOffset) {
+    std::vector<UserTable::Columns> tables = shards.freeze();
+    return saveSnapshot(path, tables, channels, shards.usernames().state(), logOffset);
+}
+
+// Loads the snapshot in data[0, fileSize) into the shards, replacing their tables. The snapshot
+// may come from a server with another shard count; its users are then spread over the shards
+// by name, and it restores the username allocator. path only names the snapshot in messages.
+// False when it fails a check; the shards are empty then.
+inline bool loadSnapshot(const char* data, std::size_t fileSize, const std::string& path,
+                         UserShards& shards, ChannelRegistry& channels, SnapshotInfo& info) {
+    using namespace snapshotformat;
+    if (fileSize < headerSize) {
+        std::cerr << "[Snapshot] " << path << " is te kort" << std::endl;
+        return false;
+    }
+    const char* header = data;
+    std::uint64_t payloadSize = mutationformat::getInt(header + 24, 8);
+    if (std::memcmp(header, magic, sizeof(magic)) != 0
+        || mutationformat::getInt(header + 36, 4) != mutationformat::crc32(header, headerSize - 4)) {
+        std::cerr << "[Snapshot] " << path << " is geen snapshot" << std::endl;
+        return false;
+    }
+    std::uint64_t fileVersion = mutationformat::getInt(header + 8, 4);
+    if (fileVersion < 2 || fileVersion > version) {
+        std::cerr << "[Snapshot] " << path << " heeft versie " << fileVersion << ", verwacht " << version << std::endl;
+        return false;
+    }
+    if (payloadSize != fileSize - headerSize
+        || mutationformat::getInt(header + 32, 4) != mutationformat::crc32(header + headerSize, fileSize - headerSize)) {
+        std::cerr << "[Snapshot] " << path << " is beschadigd (checksum)" << std::endl;
+        return false;
+    }
+    std::size_t savedShards = static_cast<std::size_t>(mutationformat::getInt(header + 12, 4));
+    info.logOffset = mutationformat::getInt(header + 16, 8);
+
+    Reader payload(header + headerSize, fileSize - headerSize);
+    std::size_t channelCount = static_cast<std::size_t>(payload.getInt(4));
+    std::vector<ChannelId> channelIds;
+    for (std::size_t i = 0; i < channelCount && payload.ok(); ++i) {
+        channelIds.push_back(channels.intern(payload.getText()));
+    }
+    // Version 2 has no allocator state: its names were random, the allocator keeps its own key
+    UsernameAllocator::State usernames;
+    bool hasUsernames = fileVersion >= 3;
+    if (hasUsernames) {
+        usernames.end = payload.getInt(8);
+        for (std::uint64_t& word : usernames.key) word = payload.getInt(8);
+    }
+    bool ok = payload.ok();
+    info.users = 0;
+    // Each table is built once and then assigned to both copies of its shard: the copies
+    // share the column chunks until a write gives one of them its own (see cowcolumn.h)
+    auto install = [&](std::size_t shard, const UserTable& loaded) {
+        shards.shard(shard).transact([&](UserTable& table, bool& changed) {
+            table = loaded;
+            changed = true;
+            return 0;
+        });
+        info.users += loaded.size();
+    };
+    if (savedShards == shards.size()) {
+        // Same layout: every shard loads its own table
+        for (std::size_t i = 0; i < savedShards && ok; ++i) {
+            UserTable loaded;
+            ok = loaded.load(payload, channelIds);
+            if (ok) install(i, loaded);
+        }
+    } else {
+        std::vector<UserTable> saved(savedShards);
+        for (std::size_t i = 0; i < savedShards && ok; ++i) ok = saved[i].load(payload, channelIds);
+        // Each name moves with all of its registrations, oldest first so the order stays. The
+        // names are hashed once up front, which also gives every new table its size.
+        std::vector<std::vector<std::pair<std::size_t, UserId>>> heads(shards.size()); // (saved shard, head)
+        std::vector<std::size_t> rows(shards.size());
+        for (std::size_t i = 0; i < saved.size() && ok; ++i) {
+            saved[i].forEachName([&](std::string_view name, UserId head) {
+                std::size_t target = shards.shardFor(name);
+                heads[target].emplace_back(i, head);
+                for (UserId id = head; id != noUser; id = saved[i].previousRegistration(id)) ++rows[target];
+            });
+        }
+        for (std::size_t target = 0; target < shards.size() && ok; ++target) {
+            UserTable table;
+            table.reserve(rows[target]);
+            std::vector<UserId> chain;
+            for (const auto& [i, head] : heads[target]) {
+                const UserTable& source = saved[i];
+                chain.clear();
+                for (UserId id = head; id != noUser; id = source.previousRegistration(id)) chain.push_back(id);
+                for (auto it = chain.rbegin(); it != chain.rend(); ++it) table.addCopy(source.name(head), source, *it);
+            }
+            heads[target] = {};
+            install(target, table);
+        }
+    }
+    if (ok && hasUsernames) shards.usernames().restore(usernames);
+    if (!ok) {
+        std::cerr << "[Snapshot] " << path << " bevat ongeldige gegevens" << std::endl;
+        for (std::size_t i = 0; i < shards.size(); ++i) {
+            shards.shard(i).transact([](UserTable& table, bool& changed) {
+                table = UserTable();
+                changed = true;
+                return 0;
+            });
+        }
+        info = SnapshotInfo();
+    }
+    return ok;
+}
+
+// Loads a snapshot written by saveSnapshot into empty shards, see above.
+// False when there is no snapshot or it fails a check; the shards are empty then.
+inline bool loadSnapshot(const std::string& path, UserShards& shards, ChannelRegistry& channels, SnapshotInfo& info) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    std::size_t fileSize = static_cast<std::size_t>(in.tellg());
+    // One sequential read of the whole file, without zero-filling the buffer first
+    std::unique_ptr<char[]> data(new char[fileSize > 0 ? fileSize : 1]);
+    in.seekg(0);
+    in.read(data.get(), static_cast<std::streamsize>(fileSize));
+    if (!in) return false;
+    in.close();
+    return loadSnapshot(data.get(), fileSize, path, shards, channels, info);
+}
+
+// Writes a snapshot every interval on its own thread while the server keeps running.
+// It freezes the shards (UserShards::freeze), which only stops their writers for the copy of
+// the chunk pointers, and writes the frozen tables; a handle thread that changes a row
+// meanwhile copies that chunk first. The stats show how long a snapshot took and how many
+// bytes of chunks were copied for it, the extra memory it held until it finished.
+class SnapshotThread {
+private:
+    std::string path;
+    UserShards& shards;
+    const ChannelRegistry& channels;
+    WriteAheadLog* log; // may be null: the snapshot then covers no log
+    std::chrono::seconds interval;
+    ServerStats& stats;
+    std::size_t statsSection;
+
+    std::mutex stopMutex;
+    std::condition_variable stopRequested;
+    bool stopping = false;
+    std::thread thread;
+
+    std::atomic<std::uint64_t> taken{0};
+    std::atomic<std::uint64_t> failed{0};
+    std::atomic<std::uint64_t> lastMicros{0};
+    std::atomic<std::uint64_t> lastSize{0};
+    std::atomic<std::uint64_t> lastUsers{0};
+    std::atomic<std::uint64_t> lastCopiedBytes{0};
+
+    void run() {
+        std::unique_lock<std::mutex> lock(stopMutex);
+        while (!stopRequested.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            take();
+            lock.lock();
+        }
+    }
+
+    void printStats(std::ostream& out) {
+        if (taken.load() == 0 && failed.load() == 0) return;
+        out << "  [snapshot] " << taken.load() << " geschreven, " << failed.load() << " mislukt; laatste: "
+            << std::fixed << std::setprecision(2) << lastMicros.load() / 1e6 << " s, "
+            << lastUsers.load() << " gebruikers, " << std::setprecision(1)
+            << lastSize.load() / 1048576.0 << " MB, extra geheugen "
+            << lastCopiedBytes.load() / 1048576.0 << " MB" << std::endl;
+    }
+
+public:
+    SnapshotThread(const std::string& snapshotPath, UserShards& userShards, const ChannelRegistry& channelRegistry,
+                   WriteAheadLog* writeAheadLog, std::chrono::seconds snapshotInterval, ServerStats& serverStats)
+        : path(snapshotPath), shards(userShards), channels(channelRegistry), log(writeAheadLog),
+          interval(snapshotInterval), stats(serverStats) {
+        statsSection = stats.addSection([this](std::ostream& out, double) {
+            printStats(out);
+        });
+    }
+
+    SnapshotThread(const SnapshotThread&) = delete;
+    SnapshotThread& operator=(const SnapshotThread&) = delete;
+
+    ~SnapshotThread() {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stopping = true;
+        }
+        stopRequested.notify_one();
+        if (thread.joinable()) thread.join();
+        stats.removeSection(statsSection);
+    }
+
+    void start() {
+        thread = std::thread(&SnapshotThread::run, this);
+    }
+
+    // Takes one snapshot on the calling thread
+    bool take() {
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t copiedBefore = CowStats::copiedBytes.load(std::memory_order_relaxed);
+
+        // The log position is taken before the shards are frozen, so every change logged
+        // before it is in the tables. Changes after it may be in them too: replaying a record
+        // sets the same fields to the same values again, so the result does not change.
+        std::uint64_t logOffset = log != nullptr ? log->position() : 0;
+        std::vector<UserTable::Columns> tables = shards.freeze();
+        UsernameAllocator::State usernames = shards.usernames().state();
+        if (log != nullptr) log->waitUntilWritten(logOffset);
+
+        bool ok = saveSnapshot(path, tables, channels, usernames, logOffset);
+        std::uint64_t copied = CowStats::copiedBytes.load(std::memory_order_relaxed) - copiedBefore;
+        std::size_t users = 0;
+        for (const UserTable::Columns& table : tables) users += table.size();
+        tables.clear();
+
+        if (!ok) {
+            failed.fetch_add(1);
+            return false;
+        }
+        std::error_code error;
+        lastSize = static_cast<std::uint64_t>(std::filesystem::file_size(path, error));
+        lastUsers = users;
+        lastCopiedBytes = copied;
+        lastMicros = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        taken.fetch_add(1);
+        return true;
+    }
+};
+
+#endif // SNAPSHOT_H
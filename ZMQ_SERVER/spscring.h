@@ -0,0 +1,96 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+// Bounded ring buffer for exactly one producer thread and one consumer thread.
+// head and tail only grow; the slot is index & mask, so the capacity is a power of two.
+// Each side keeps a cached copy of the other side's index and only reloads the shared
+// atomic when the ring looks full (producer) or empty (consumer).
+template <typename T>
+class SpscRing {
+private:
+    std::vector<T> slots;
+    std::size_t mask;
+
+    alignas(64) std::atomic<std::size_t> head{0}; // next slot to pop, written by the consumer
+    std::size_t cachedTail = 0;                   // consumer's copy of tail
+
+    alignas(64) std::atomic<std::size_t> tail{0}; // next slot to push, written by the producer
+    std::size_t cachedHead = 0;                   // producer's copy of head
+
+    static std::size_t roundUpToPowerOfTwo(std::size_t value) {
+        std::size_t result = 1;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+public:
+    explicit SpscRing(std::size_t capacity)
+        : slots(roundUpToPowerOfTwo(capacity < 2 ? 2 : capacity)), mask(slots.size() - 1) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    std::size_t capacity() const {
+        return slots.size();
+    }
+
+    // Number of queued items, approximate when read from a third thread. head is read first:
+    // it never passes tail, so the tail read after it is at least as far. Read the other way
+    // round, pops between the two reads could put head past the tail already read.
+    std::size_t size() const {
+        std::size_t h = head.load(std::memory_order_acquire);
+        std::size_t t = tail.load(std::memory_order_acquire);
+        return h > t ? 0 : t - h;
+    }
+
+    // Producer only
+    bool tryPush(T& value) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead == slots.size()) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead == slots.size()) return false;
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only
+    bool tryPop(T& value) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail) return false;
+        }
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocking variants: spin a little, then yield, then sleep while the ring is full/empty
+    void push(T& value) {
+        for (unsigned spins = 0; !tryPush(value); ++spins) backoff(spins);
+    }
+
+    void pop(T& value) {
+        for (unsigned spins = 0; !tryPop(value); ++spins) backoff(spins);
+    }
+
+    static void backoff(unsigned spins) {
+        if (spins < 64) return;
+        if (spins < 128) {
+            std::this_thread::yield();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+};
+
+#endif // SPSCRING_H
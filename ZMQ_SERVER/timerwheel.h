@@ -0,0 +1,191 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+// Hierarchical timing wheel with a Value per timer. Time is counted in ticks chosen by the owner.
+// Level 0 has a slot for each of the next 64 ticks, level 1 a slot for each of the next 64
+// blocks of 64 ticks, and so on over four levels (2^24 ticks). When level 0 wraps around, the
+// next slot of level 1 is spread over level 0, and likewise further up (cascading).
+//
+// Every slot is a circular doubly linked list of nodes in one array, so adding or removing a
+// timer links or unlinks one node: O(1) however many timers are pending. Re-arming to a later
+// deadline only stores the new deadline; the timer stays where it is and is placed again when
+// its old slot comes up. A session that sends a heartbeat every few seconds against a timeout
+// of a minute is therefore moved about once per timeout, not once per heartbeat.
+//
+// advance() does not report the timers that expire: they go to a queue that the owner empties
+// with popExpired() at its own pace. Not thread safe.
+template <typename Value>
+class TimerWheel {
+public:
+    using Timer = std::uint32_t;
+
+private:
+    static constexpr unsigned slotBits = 6;
+    static constexpr unsigned levels = 4;
+    static constexpr Timer slotsPerLevel = Timer(1) << slotBits;
+    static constexpr Timer expiredList = levels * slotsPerLevel;
+    static constexpr Timer freeList = expiredList + 1;
+    static constexpr Timer scratchList = expiredList + 2; // a slot being emptied
+    static constexpr Timer firstTimer = expiredList + 3;  // nodes before this one are list heads
+
+    struct Node {
+        std::uint64_t deadline;
+        Timer previous;
+        Timer next;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Value> values; // of timer firstTimer + i at i
+    std::uint64_t nextTick;    // ticks before this one have been processed
+    std::size_t pending = 0;
+
+    static Timer slotOf(unsigned level, std::uint64_t tick) {
+        return static_cast<Timer>(level * slotsPerLevel + ((tick >> (slotBits * level)) & (slotsPerLevel - 1)));
+    }
+
+    // The slot a timer due at deadline goes in, seen from nextTick; the expired queue when it is past
+    Timer slotFor(std::uint64_t deadline) const {
+        if (deadline < nextTick) return expiredList;
+        std::uint64_t delta = deadline - nextTick;
+        for (unsigned level = 0; level < levels; ++level) {
+            if (delta < (std::uint64_t(1) << (slotBits * (level + 1)))) return slotOf(level, deadline);
+        }
+        // Further away than the wheel reaches: the last slot of the top level, from where it is placed again
+        return slotOf(levels - 1, nextTick + (std::uint64_t(1) << (slotBits * levels)) - 1);
+    }
+
+    bool isEmpty(Timer list) const {
+        return nodes[list].next == list;
+    }
+
+    void unlink(Timer timer) {
+        Node& node = nodes[timer];
+        nodes[node.previous].next = node.next;
+        nodes[node.next].previous = node.previous;
+    }
+
+    // Appends timer to list
+    void link(Timer list, Timer timer) {
+        Node& node = nodes[timer];
+        node.previous = nodes[list].previous;
+        node.next = list;
+        nodes[node.previous].next = timer;
+        nodes[list].previous = timer;
+    }
+
+    // Moves every timer of list to the empty scratch list
+    void takeAll(Timer list) {
+        if (isEmpty(list)) return;
+        Node& scratch = nodes[scratchList];
+        scratch.next = nodes[list].next;
+        scratch.previous = nodes[list].previous;
+        nodes[scratch.next].previous = scratchList;
+        nodes[scratch.previous].next = scratchList;
+        nodes[list].next = nodes[list].previous = list;
+    }
+
+    // Places the timers of slot again, seen from nextTick
+    void redistribute(Timer slot) {
+        takeAll(slot);
+        while (!isEmpty(scratchList)) {
+            Timer timer = nodes[scratchList].next;
+            unlink(timer);
+            link(slotFor(nodes[timer].deadline), timer);
+        }
+    }
+
+public:
+    // startTick is the first tick advance() processes
+    explicit TimerWheel(std::uint64_t startTick = 0) : nodes(firstTimer), nextTick(startTick) {
+        for (Timer list = 0; list < firstTimer; ++list) nodes[list] = Node{0, list, list};
+    }
+
+    // Timers waiting to expire or in the expired queue
+    std::size_t size() const {
+        return pending;
+    }
+
+    std::uint64_t currentTick() const {
+        return nextTick;
+    }
+
+    Timer add(std::uint64_t deadline, Value value) {
+        Timer timer;
+        if (!isEmpty(freeList)) {
+            timer = nodes[freeList].next;
+            unlink(timer);
+            values[timer - firstTimer] = std::move(value);
+        } else {
+            timer = static_cast<Timer>(nodes.size());
+            nodes.push_back(Node{});
+            values.push_back(std::move(value));
+        }
+        nodes[timer].deadline = deadline;
+        link(slotFor(deadline), timer);
+        ++pending;
+        return timer;
+    }
+
+    // Moves the deadline of a pending timer, also one in the expired queue
+    void rearm(Timer timer, std::uint64_t deadline) {
+        Node& node = nodes[timer];
+        bool later = deadline >= node.deadline;
+        node.deadline = deadline;
+        if (later) return;
+        unlink(timer);
+        link(slotFor(deadline), timer);
+    }
+
+    void remove(Timer timer) {
+        unlink(timer);
+        link(freeList, timer);
+        --pending;
+    }
+
+    Value& value(Timer timer) {
+        return values[timer - firstTimer];
+    }
+
+    // Processes the ticks up to and including now: timers due by then go to the expired queue
+    void advance(std::uint64_t now) {
+        while (nextTick <= now) {
+            if (pending == 0) {
+                nextTick = now + 1;
+                return;
+            }
+            std::uint64_t tick = nextTick;
+            // Level 0 wrapped: bring the next slot of the level above down, and so on up
+            for (unsigned level = 1; level < levels; ++level) {
+                if ((tick & ((std::uint64_t(1) << (slotBits * level)) - 1)) != 0) break;
+                redistribute(slotOf(level, tick));
+            }
+            // Everything left in the slot of this tick is due or was re-armed to later
+            ++nextTick;
+            redistribute(slotOf(0, tick));
+        }
+    }
+
+    // Takes the oldest expired timer and frees it; false when none has expired. Timers re-armed
+    // after they expired are put back on the wheel instead.
+    bool popExpired(Value& value) {
+        while (!isEmpty(expiredList)) {
+            Timer timer = nodes[expiredList].next;
+            unlink(timer);
+            if (nodes[timer].deadline >= nextTick) {
+                link(slotFor(nodes[timer].deadline), timer);
+                continue;
+            }
+            value = std::move(values[timer - firstTimer]);
+            link(freeList, timer);
+            --pending;
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,725 @@
+#ifndef USERMANAGER_H
+#define USERMANAGER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <iostream>
+#include <memory_resource>
+#include <functional>
+#include <tuple>
+#include <utility>
+#include <chrono>
+#include <atomic>
+#include "usertable.h"
+#include "coldstore.h"
+#include "leftright.h"
+#include "mutation.h"
+#include "writeaheadlog.h"
+#include "timerwheel.h"
+#include "usernameallocator.h"
+#include "changefeed.h"
+
+// Outcome of UserManager::logIn
+enum class LoginResult : std::uint8_t {
+    loggedIn,
+    unknownUser,
+    wrongPassword
+};
+
+// Counters of the sessions of one shard, written by its thread and read by the statistics
+struct SessionCounters {
+    std::atomic<std::uint64_t> sessions{0}; // names with a running session timer
+    std::atomic<std::uint64_t> heartbeats{0};
+    std::atomic<std::uint64_t> expired{0};
+};
+
+class UserManager {
+private:
+    ChannelRegistry& channels; // shared by all shards, has its own lock
+
+    // One row per name|channel registration, see usertable.h. The requests that only carry
+    // a client name resolve to its most recent registration.
+    // Two copies kept by LeftRight: the read methods never lock or wait, even while a
+    // registration is written, and each of them sees one consistent state of the table.
+    // Writers (one per shard in practice) take the LeftRight writer lock.
+    LeftRight<UserTable> users;
+
+    // Every change made through the methods below is appended here once it is in the table.
+    // The shard's requests are handled by one thread, so the records of a shard are in the
+    // order of its changes; changes made directly through transact() are not logged.
+    WriteAheadLog* log = nullptr;
+    ChangeFeed* feed = nullptr; // gets the same changes as events, without the passwords
+
+    // The event for a change of a user; false for records that are no user change
+    static bool changeEventKind(Mutation::Kind kind, ChangeEvent::Kind& eventKind) {
+        switch (kind) {
+        case Mutation::registerUser:
+            eventKind = ChangeEvent::registered;
+            return true;
+        case Mutation::setPassword:
+            eventKind = ChangeEvent::passwordSet;
+            return true;
+        case Mutation::logIn:
+            eventKind = ChangeEvent::login;
+            return true;
+        case Mutation::logOut:
+            eventKind = ChangeEvent::logout;
+            return true;
+        case Mutation::reserveUsernames:
+            return false;
+        }
+        return false;
+    }
+
+    void append(Mutation::Kind kind, std::string_view name, std::string_view channel,
+                GeneratedName username = GeneratedName(), std::string_view password = {}) {
+        if (feed != nullptr) {
+            std::string_view value;
+            GeneratedName::Text usernameText;
+            if (kind == Mutation::registerUser) {
+                usernameText = username.text();
+                value = usernameText;
+            }
+            ChangeEvent::Kind eventKind;
+            if (changeEventKind(kind, eventKind)) feed->publish(eventKind, name, channel, value);
+        }
+        if (log == nullptr) return;
+        Mutation mutation;
+        mutation.kind = kind;
+        mutation.name = name;
+        mutation.channel = channel;
+        mutation.username = username;
+        mutation.password = password;
+        log->append(mutation);
+    }
+
+    // Once the table holds more than hotLimit rows (0 = no limit), the names not seen for the
+    // longest time move to the cold store and come back when a request needs them. Only the
+    // shard's writer thread loads and evicts, so between its own changes the table stays as it read it.
+    ColdStore* store = nullptr;
+    std::size_t hotLimit = 0;
+    std::size_t evictAbove = 0; // table size that starts the next eviction
+    std::uint32_t epoch = 1;    // rows changed since the last eviction are marked with it
+
+    // A session timer per logged in name, armed by logIn() and re-armed by heartbeat(); the
+    // names whose timer runs out are logged out by expireSessions(). Only the shard's thread
+    // uses them. Logged in names are never evicted, so a timer always finds its name in memory.
+    using SessionTimer = TimerWheel<std::string>::Timer;
+    static constexpr std::chrono::milliseconds sessionTick{100};
+    std::uint64_t sessionTimeout = 0; // in ticks, 0 = sessions never expire
+    TimerWheel<std::string> sessionTimers;
+    FlatHashMap<std::string, SessionTimer> sessionOfName;
+
+    static std::uint64_t currentSessionTick() {
+        return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch() / sessionTick);
+    }
+
+    // Starts the session of name, or extends it when it has one
+    void armSession(std::string_view name) {
+        if (sessionTimeout == 0) return;
+        std::uint64_t deadline = currentSessionTick() + sessionTimeout;
+        std::pair<SessionTimer*, bool> entry = sessionOfName.tryEmplace(name, SessionTimer(0));
+        if (entry.second) {
+            *entry.first = sessionTimers.add(deadline, std::string(name));
+            sessionCounters.sessions.store(sessionOfName.size(), std::memory_order_relaxed);
+        } else {
+            sessionTimers.rearm(*entry.first, deadline);
+        }
+    }
+
+    void endSession(std::string_view name) {
+        SessionTimer* timer = sessionOfName.find(name);
+        if (timer == nullptr) return;
+        sessionTimers.remove(*timer);
+        sessionOfName.erase(name);
+        sessionCounters.sessions.store(sessionOfName.size(), std::memory_order_relaxed);
+    }
+
+    // Brings the registrations of name back from the cold store when it was evicted, before
+    // a change to name. Changes must see all of them: a registration in a new channel is
+    // added to the chain of the earlier ones, and the next eviction stores the whole chain.
+    void loadIfEvicted(std::string_view name) {
+        if (store == nullptr) return;
+        if (findUserByName(name) != noUser) {
+            store->counters.hits.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ColdUser cold;
+        if (!store->get(name, cold) || cold.registrations.empty()) {
+            store->counters.misses.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        store->counters.loads.fetch_add(1, std::memory_order_relaxed);
+        std::vector<ChannelId> channelIds;
+        for (const ColdRegistration& registration : cold.registrations) channelIds.push_back(channels.intern(registration.channel));
+        users.update([&](UserTable& table, bool& changed) {
+            for (std::size_t i = 0; i < channelIds.size(); ++i) {
+                const ColdRegistration& registration = cold.registrations[i];
+                UserId id = table.add(name, channelIds[i], registration.username);
+                if (registration.hasPassword) table.setPassword(id, registration.password);
+                table.touch(id, epoch);
+            }
+            changed = true;
+            return 0;
+        });
+    }
+
+    // Stores the names with the oldest epochs in the cold store until a quarter of hotLimit
+    // is free, then rebuilds the table without them. The rebuild copies the rows that stay,
+    // so it happens once per hotLimit / 4 new rows at most. Logged in names stay in memory.
+    void evict() {
+        struct Candidate {
+            std::uint32_t seen;
+            UserId head;
+            std::size_t rows;
+        };
+        std::vector<ColdUser> evicted;
+        std::vector<bool> isEvicted;
+        std::size_t evictedRows = 0;
+        users.read([&](const UserTable& table) {
+            std::vector<Candidate> candidates;
+            table.forEachName([&](std::string_view, UserId head) {
+                Candidate candidate{0, head, 0};
+                bool loggedIn = false;
+                for (UserId id = head; id != noUser; id = table.previousRegistration(id)) {
+                    candidate.seen = std::max(candidate.seen, table.lastSeenEpoch(id));
+                    loggedIn = loggedIn || table.isLoggedIn(id);
+                    ++candidate.rows;
+                }
+                if (!loggedIn) candidates.push_back(candidate);
+            });
+            std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+                return a.seen < b.seen;
+            });
+
+            std::size_t excess = table.size() - (hotLimit - hotLimit / 4);
+            isEvicted.assign(table.size(), false);
+            for (const Candidate& candidate : candidates) {
+                if (evictedRows >= excess) break;
+                ColdUser& user = evicted.emplace_back();
+                user.name = table.name(candidate.head);
+                for (UserId id = candidate.head; id != noUser; id = table.previousRegistration(id)) {
+                    ColdRegistration& registration = user.registrations.emplace_back();
+                    registration.channel = channels.name(table.channel(id));
+                    registration.username = table.generatedUsername(id);
+                    registration.hasPassword = table.isPasswordSet(id);
+                    registration.password = table.password(id);
+                }
+                std::reverse(user.registrations.begin(), user.registrations.end());
+                if (!coldformat::fits(user)) {
+                    evicted.pop_back(); // the store would cut it off, so it stays in memory
+                    continue;
+                }
+                isEvicted[candidate.head] = true;
+                evictedRows += candidate.rows;
+            }
+        });
+        std::size_t evictedNames = evicted.size();
+        if (evictedNames == 0 || !store->put(evicted)) {
+            if (evictedNames > 0) std::cerr << "[Users] Verplaatsen naar de cold store mislukt, gebruikers blijven in geheugen" << std::endl;
+            evictAbove += hotLimit / 4;
+            return;
+        }
+
+        // Built once, then both copies share its chunks
+        UserTable kept;
+        users.read([&](const UserTable& table) {
+            kept.reserve(table.size() - evictedRows);
+            std::vector<UserId> chain;
+            table.forEachName([&](std::string_view name, UserId head) {
+                if (isEvicted[head]) return;
+                chain.clear();
+                for (UserId id = head; id != noUser; id = table.previousRegistration(id)) chain.push_back(id);
+                for (auto it = chain.rbegin(); it != chain.rend(); ++it) kept.addCopy(name, table, *it);
+            });
+        });
+        users.update([&](UserTable& table, bool& changed) {
+            table = kept;
+            changed = true;
+            return 0;
+        });
+        evictAbove = hotLimit;
+        ++epoch;
+        store->counters.evictedNames.fetch_add(evictedNames, std::memory_order_relaxed);
+        store->counters.evictedRows.fetch_add(evictedRows, std::memory_order_relaxed);
+    }
+
+    // Registrations of an evicted name, for the read methods; reading them does not bring it back
+    bool findEvicted(std::string_view name, ColdUser& user) const {
+        return store != nullptr && store->get(name, user) && !user.registrations.empty();
+    }
+
+    const ColdRegistration* findEvictedKey(std::string_view key, ColdUser& user) const {
+        std::size_t separator = key.find('|');
+        if (separator == std::string_view::npos || !findEvicted(key.substr(0, separator), user)) return nullptr;
+        for (const ColdRegistration& registration : user.registrations) {
+            if (registration.channel == key.substr(separator + 1)) return &registration;
+        }
+        return nullptr;
+    }
+
+    // Client names never contain '|', so the name of a key ends at its first '|'
+    static UserId findKey(const UserTable& table, const ChannelRegistry& channels, std::string_view key) {
+        std::size_t separator = key.find('|');
+        if (separator == std::string_view::npos) return noUser;
+        ChannelId channel = channels.find(key.substr(separator + 1));
+        if (channel == noChannel) return noUser;
+        return table.find(key.substr(0, separator), channel);
+    }
+
+public:
+    SessionCounters sessionCounters;
+
+    explicit UserManager(ChannelRegistry& channelRegistry) : channels(channelRegistry) {}
+
+    // Starts logging the changes, after the log has been replayed
+    void attachLog(WriteAheadLog* writeAheadLog) {
+        log = writeAheadLog;
+    }
+
+    // Starts publishing the changes as events, also after the log has been replayed
+    void attachFeed(ChangeFeed* changeFeed) {
+        feed = changeFeed;
+    }
+
+    // Moves the names this shard has not seen for the longest time to store once it holds
+    // more than maxRows registrations (0 = never). Attach before the log is replayed, so
+    // records for evicted names find them.
+    void attachStore(ColdStore* coldStore, std::size_t maxRows) {
+        store = coldStore;
+        hotLimit = maxRows;
+        evictAbove = maxRows;
+    }
+
+    // Evicts when the table holds more than the limit of attachStore. The changes below
+    // call it themselves; after loading a snapshot the caller does.
+    void evictIfFull() {
+        if (store == nullptr || hotLimit == 0) return;
+        if (users.read([](const UserTable& table) { return table.size(); }) <= evictAbove) return;
+        evict();
+    }
+
+    // Logs out the names that send no heartbeat for timeout (0 = never), see expireSessions().
+    // The names logged in now, e.g. restored from the log, get a session too: a client that
+    // went away while the server was down expires like any other.
+    void expireSessionsAfter(std::chrono::milliseconds timeout) {
+        sessionTimeout = timeout.count() > 0 ? static_cast<std::uint64_t>((timeout + sessionTick - std::chrono::milliseconds(1)) / sessionTick) : 0;
+        sessionTimers = TimerWheel<std::string>(currentSessionTick());
+        sessionOfName.clear();
+        sessionCounters.sessions.store(0, std::memory_order_relaxed);
+        std::vector<std::string> loggedIn;
+        users.read([&](const UserTable& table) {
+            table.forEachLoggedIn([&](UserId id) {
+                loggedIn.emplace_back(table.name(id));
+            });
+        });
+        for (const std::string& name : loggedIn) armSession(name);
+    }
+
+    bool sessionsExpire() const {
+        return sessionTimeout > 0;
+    }
+
+    // Logs out at most limit of the names whose session ran out, with one switch of the table
+    // for all of them. Returns the number of sessions it took from the wheel: when that is
+    // limit, more may be waiting. The shard's thread calls it between requests, so a burst of
+    // expiries is spread over several calls instead of holding up the requests behind it.
+    std::size_t expireSessions(std::size_t limit) {
+        if (sessionTimeout == 0) return 0;
+        sessionTimers.advance(currentSessionTick());
+        std::vector<std::string> names;
+        std::string name;
+        while (names.size() < limit && sessionTimers.popExpired(name)) {
+            sessionOfName.erase(name);
+            names.push_back(std::move(name));
+        }
+        if (names.empty()) return 0;
+        sessionCounters.sessions.store(sessionOfName.size(), std::memory_order_relaxed);
+
+        // A name may have logged out since its session started. The session belongs to the name,
+        // so every logged in registration of it ends, not only the most recent one.
+        std::vector<std::pair<std::size_t, ChannelId>> loggedOut; // (index in names, channel)
+        users.update([&](UserTable& table, bool& changed) {
+            for (std::size_t i = 0; i < names.size(); ++i) {
+                for (UserId id = table.find(names[i]); id != noUser; id = table.previousRegistration(id)) {
+                    if (!table.isLoggedIn(id)) continue;
+                    table.setLoggedIn(id, false);
+                    table.touch(id, epoch);
+                    loggedOut.emplace_back(i, table.channel(id));
+                    changed = true;
+                }
+            }
+            return 0;
+        });
+        std::size_t expired = 0;
+        for (std::size_t i = 0; i < loggedOut.size(); ++i) {
+            append(Mutation::logOut, names[loggedOut[i].first], channels.name(loggedOut[i].second));
+            if (i == 0 || loggedOut[i].first != loggedOut[i - 1].first) ++expired;
+        }
+        if (expired > 0) {
+            sessionCounters.expired.fetch_add(expired, std::memory_order_relaxed);
+            std::cout << "[Users] " << expired << " sessies verlopen" << std::endl;
+        }
+        return names.size();
+    }
+
+    // service>heartbeat?>: extends the session of name. False when no registration of name is
+    // logged in, e.g. because its session expired.
+    bool heartbeat(std::string_view name) {
+        sessionCounters.heartbeats.fetch_add(1, std::memory_order_relaxed);
+        bool loggedIn = users.read([&](const UserTable& table) {
+            for (UserId id = table.find(name); id != noUser; id = table.previousRegistration(id)) {
+                if (table.isLoggedIn(id)) return true;
+            }
+            return false;
+        });
+        if (loggedIn) armSession(name);
+        return loggedIn;
+    }
+
+    // Applies a replayed log record; it is not logged again. False when it changes a registration
+    // the shard does not have, which means the records before it are missing.
+    bool apply(const Mutation& mutation) {
+        loadIfEvicted(mutation.name);
+        ChannelId channel = channels.intern(mutation.channel);
+        UserId changedId = users.update([&](UserTable& table, bool& changed) {
+            UserId id = mutation.kind == Mutation::registerUser
+                ? table.add(mutation.name, channel, mutation.username)
+                : table.find(mutation.name, channel);
+            if (id == noUser) return id;
+            if (mutation.kind == Mutation::setPassword) {
+                table.setPassword(id, mutation.password);
+            } else if (mutation.kind != Mutation::registerUser) {
+                table.setLoggedIn(id, mutation.kind == Mutation::logIn);
+            }
+            table.touch(id, epoch);
+            changed = true;
+            return id;
+        });
+        evictIfFull();
+        return changedId != noUser;
+    }
+
+    // Point-in-time copy of the rows for a snapshot, see UserTable::freeze. It runs between
+    // two writes on the copy no reader uses, and only once: nothing changes, so update() does
+    // not switch copies. Writers wait only for the copy of the chunk pointers.
+    UserTable::Columns freeze() {
+        return users.update([](UserTable& table, bool&) {
+            return table.freeze();
+        });
+    }
+
+    // Runs fn(const UserTable&) on one consistent state of the table, without locking
+    template <typename Fn>
+    auto view(Fn&& fn) const {
+        return users.read(std::forward<Fn>(fn));
+    }
+
+    // Runs a read-modify-write sequence as one step: fn(UserTable&, bool& changed) sees no
+    // other writer in between and sets changed when it modified the table. fn runs on both
+    // copies of the table (see LeftRight::update), so it may only depend on its captures and
+    // the table, and must not have side effects outside it.
+    template <typename Fn>
+    auto transact(Fn&& fn) {
+        return users.update(std::forward<Fn>(fn));
+    }
+
+    // service>login?>: find the name, check the password and log in, in one step
+    LoginResult logIn(std::string_view name, std::string_view password) {
+        loadIfEvicted(name);
+        std::pair<LoginResult, ChannelId> result = transact([&](UserTable& table, bool& changed) {
+            UserId id = table.find(name);
+            if (id == noUser) return std::make_pair(LoginResult::unknownUser, noChannel);
+            if (!table.verifyPassword(id, password)) return std::make_pair(LoginResult::wrongPassword, noChannel);
+            table.setLoggedIn(id, true);
+            table.touch(id, epoch);
+            changed = true;
+            return std::make_pair(LoginResult::loggedIn, table.channel(id));
+        });
+        if (result.first == LoginResult::loggedIn) {
+            append(Mutation::logIn, name, channels.name(result.second));
+            armSession(name);
+        }
+        evictIfFull();
+        return result.first;
+    }
+
+    // service>password?>: gives the most recent registration of name this password.
+    // False when name is not registered.
+    bool setPasswordOfName(std::string_view name, std::string_view password) {
+        loadIfEvicted(name);
+        ChannelId channel = transact([&](UserTable& table, bool& changed) {
+            UserId id = table.find(name);
+            if (id == noUser) return noChannel;
+            table.setPassword(id, password);
+            table.touch(id, epoch);
+            changed = true;
+            return table.channel(id);
+        });
+        if (channel == noChannel) return false;
+        append(Mutation::setPassword, name, channels.name(channel), GeneratedName(), password);
+        evictIfFull();
+        return true;
+    }
+
+    // service>logout?>: logs out the most recent registration of name and returns its
+    // generated username in loggedOut. False when name is not registered. The session of name
+    // goes on while an older registration of it is still logged in.
+    bool logOut(std::string_view name, GeneratedName& loggedOut) {
+        loadIfEvicted(name);
+        std::tuple<ChannelId, GeneratedName, bool> result = transact([&](UserTable& table, bool& changed) {
+            UserId id = table.find(name);
+            if (id == noUser) return std::make_tuple(noChannel, GeneratedName(), false);
+            table.setLoggedIn(id, false);
+            table.touch(id, epoch);
+            changed = true;
+            bool stillLoggedIn = false;
+            for (UserId older = table.previousRegistration(id); older != noUser; older = table.previousRegistration(older)) {
+                stillLoggedIn = stillLoggedIn || table.isLoggedIn(older);
+            }
+            return std::make_tuple(table.channel(id), table.generatedUsername(id), stillLoggedIn);
+        });
+        if (std::get<0>(result) == noChannel) return false;
+        append(Mutation::logOut, name, channels.name(std::get<0>(result)));
+        if (!std::get<2>(result)) endSession(name);
+        loggedOut = std::get<1>(result);
+        evictIfFull();
+        return true;
+    }
+
+    // The table owns its strings; the string_view arguments are only copied when something
+    // is stored. Ids stay valid until the next eviction; the methods taking names and keys
+    // also find evicted users.
+    // key = name|channel
+    bool isUserRegistered(std::string_view key) const {
+        bool nameInMemory = false;
+        bool found = users.read([&](const UserTable& table) {
+            nameInMemory = table.find(key.substr(0, key.find('|'))) != noUser;
+            return findKey(table, channels, key) != noUser;
+        });
+        ColdUser evicted;
+        return found || (!nameInMemory && findEvictedKey(key, evicted) != nullptr);
+    }
+
+    std::string getRegisteredUsername(std::string_view key) const {
+        bool nameInMemory = false;
+        std::string username = users.read([&](const UserTable& table) {
+            nameInMemory = table.find(key.substr(0, key.find('|'))) != noUser;
+            UserId id = findKey(table, channels, key);
+            if (id != noUser) return std::string(table.generatedUsername(id).text());
+            return std::string();
+        });
+        ColdUser evicted;
+        const ColdRegistration* registration = nameInMemory ? nullptr : findEvictedKey(key, evicted);
+        if (registration != nullptr) username = registration->username.text();
+        return username;
+    }
+
+    UserId registerUser(std::string_view name, std::string_view channel, GeneratedName username) {
+        loadIfEvicted(name);
+        ChannelId channelId = channels.intern(channel);
+        UserId id = users.write([&](UserTable& table) {
+            UserId added = table.add(name, channelId, username);
+            table.touch(added, epoch);
+            return added;
+        });
+        append(Mutation::registerUser, name, channel, username);
+        evictIfFull();
+        return id;
+    }
+
+    // Most recent registration of the client name, or noUser
+    UserId findUserByName(std::string_view name) const {
+        return users.read([&](const UserTable& table) {
+            return table.find(name);
+        });
+    }
+
+    // Registration of name in one specific channel, or noUser
+    UserId findUser(std::string_view name, std::string_view channel) const {
+        ChannelId channelId = channels.find(channel);
+        if (channelId == noChannel) return noUser;
+        return users.read([&](const UserTable& table) {
+            return table.find(name, channelId);
+        });
+    }
+
+    bool verifyPassword(UserId id, std::string_view password) const {
+        return users.read([&](const UserTable& table) {
+            return table.verifyPassword(id, password);
+        });
+    }
+
+    // name|channel key of the most recent registration of name
+    std::string findUserKeyByName(std::string_view name) const {
+        ChannelId channel = users.read([&](const UserTable& table) {
+            UserId id = table.find(name);
+            return id != noUser ? table.channel(id) : noChannel;
+        });
+        ColdUser evicted;
+        if (channel == noChannel && !findEvicted(name, evicted)) return "";
+        std::string key(name);
+        key += '|';
+        key += channel != noChannel ? channels.name(channel) : evicted.registrations.back().channel;
+        return key;
+    }
+
+    // Helper to get the generated username from the client's provided name (its most recent registration)
+    std::string getGeneratedUsernameFromName(std::string_view name) const {
+        std::string username = users.read([&](const UserTable& table) {
+            UserId id = table.find(name);
+            if (id == noUser) return std::string();
+            return std::string(table.generatedUsername(id).text());
+        });
+        ColdUser evicted;
+        if (username.empty() && findEvicted(name, evicted)) username = evicted.registrations.back().username.text();
+        return username;
+    }
+
+    GeneratedName getGeneratedUsername(UserId id) const {
+        return users.read([&](const UserTable& table) {
+            return table.generatedUsername(id);
+        });
+    }
+
+    // Channels name is registered in, most recent first
+    std::vector<std::string> getChannelsOfName(std::string_view name) const {
+        std::vector<ChannelId> ids = users.read([&](const UserTable& table) {
+            std::vector<ChannelId> found;
+            for (UserId id = table.find(name); id != noUser; id = table.previousRegistration(id)) {
+                found.push_back(table.channel(id));
+            }
+            return found;
+        });
+        std::vector<std::string> names;
+        for (ChannelId id : ids) names.emplace_back(channels.name(id));
+        ColdUser evicted;
+        if (names.empty() && findEvicted(name, evicted)) {
+            for (auto it = evicted.registrations.rbegin(); it != evicted.registrations.rend(); ++it) names.push_back(it->channel);
+        }
+        return names;
+    }
+
+    // Appends the generated usernames of the logged in users to loggedIn, which normally lives in the request arena
+    void getLoggedInUsers(std::pmr::vector<std::pmr::string>& loggedIn) const {
+        users.read([&](const UserTable& table) {
+            table.forEachLoggedIn([&](UserId id) {
+                loggedIn.emplace_back(std::string_view(table.generatedUsername(id).text()));
+            });
+        });
+    }
+
+    std::string getUserChannel(UserId id) const {
+        ChannelId channel = users.read([id](const UserTable& table) {
+            return table.channel(id);
+        });
+        return std::string(channels.name(channel));
+    }
+};
+
+// Shard of a client name among count shards
+inline std::size_t shardOfName(std::string_view name, std::size_t count) {
+    return std::hash<std::string_view>{}(name) % count;
+}
+
+// Splits the user state into one UserManager per worker thread.
+// A user always lives in the shard picked by its client name: the password, login and
+// logout requests only carry the name, so name|channel keys of the same name must end
+// up in the same shard for those lookups to find them.
+class UserShards {
+private:
+    std::deque<UserManager> shards; // UserManager cannot move (it holds a mutex)
+    UsernameAllocator allocator;    // shared by the shards: a name is unique over all of them
+    ChangeFeed* feed = nullptr;
+
+public:
+    UserShards(std::size_t count, ChannelRegistry& channels) {
+        for (std::size_t i = 0; i < (count > 0 ? count : 1); ++i) shards.emplace_back(channels);
+    }
+
+    std::size_t size() const {
+        return shards.size();
+    }
+
+    std::size_t shardFor(std::string_view name) const {
+        return shardOfName(name, shards.size());
+    }
+
+    UserManager& shard(std::size_t index) {
+        return shards[index];
+    }
+
+    UserManager& shardForName(std::string_view name) {
+        return shards[shardFor(name)];
+    }
+
+    // Applies a log record to the shard of its name (see UserManager::apply)
+    bool apply(const Mutation& mutation) {
+        if (mutation.kind == Mutation::reserveUsernames) {
+            allocator.apply(mutation);
+            return true;
+        }
+        return shardForName(mutation.name).apply(mutation);
+    }
+
+    // Applies the log at path from offset on (see WriteAheadLog::replay), returns the record count
+    std::size_t replay(const std::string& path, std::uint64_t& offset) {
+        return WriteAheadLog::replay(path, offset, [this](const Mutation& mutation) {
+            apply(mutation);
+        });
+    }
+
+    void attachLog(WriteAheadLog* log) {
+        for (auto& manager : shards) manager.attachLog(log);
+        allocator.attachLog(log);
+    }
+
+    // Generated usernames for new registrations, from any handle thread
+    UsernameAllocator& usernames() {
+        return allocator;
+    }
+
+    void attachFeed(ChangeFeed* changeFeed) {
+        feed = changeFeed;
+        for (auto& manager : shards) manager.attachFeed(changeFeed);
+    }
+
+    // For the events that are not user changes, such as chat messages; null without a feed
+    ChangeFeed* changeFeed() const {
+        return feed;
+    }
+
+    // Keeps at most about maxRows registrations in memory over all shards (see UserManager::attachStore)
+    void attachStore(ColdStore* store, std::size_t maxRows) {
+        std::size_t perShard = (maxRows + shards.size() - 1) / shards.size();
+        for (auto& manager : shards) manager.attachStore(store, perShard);
+    }
+
+    // Evicts what a loaded snapshot brought in above the limit
+    void evictIfFull() {
+        for (auto& manager : shards) manager.evictIfFull();
+    }
+
+    void expireSessionsAfter(std::chrono::milliseconds timeout) {
+        for (auto& manager : shards) manager.expireSessionsAfter(timeout);
+    }
+
+    // Frozen copy of every shard, in shard order. Each shard is frozen at its own moment.
+    std::vector<UserTable::Columns> freeze() {
+        std::vector<UserTable::Columns> tables;
+        for (auto& manager : shards) tables.push_back(manager.freeze());
+        return tables;
+    }
+
+    // Logged in users of every shard, used by service>clients?>
+    void getLoggedInUsers(std::pmr::vector<std::pmr::string>& users) const {
+        for (const auto& manager : shards) {
+            manager.getLoggedInUsers(users);
+        }
+    }
+};
+
+#endif // USERMANAGER_H
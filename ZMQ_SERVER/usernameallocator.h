@@ -0,0 +1,171 @@
+#ifndef USERNAMEALLOCATOR_H
+#define USERNAMEALLOCATOR_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include "generatedname.h"
+#include "mutation.h"
+#include "writeaheadlog.h"
+
+// Hands out the usernames of new registrations, each one different from every name handed
+// out before, without a lookup. Name n is a keyed permutation of the counter n over the 62^8
+// packed values: a six round Feistel network over 48 bits, applied again while the result is
+// 62^8 or more (cycle walking, 1.3 times on average) so it stays within the names. Consecutive
+// counters give unrelated looking names, and without the key their order cannot be told.
+//
+// Threads take their counter with one atomic add. The counters are reserved in blocks: before
+// the first name of a block is handed out, a record with the end of the block and the key
+// goes into the write-ahead log (and so to the followers), and every snapshot carries both
+// too. After a restart the allocator continues at the end of the last reserved block. Names
+// from before the allocator were drawn at random and can still come up once more.
+class UsernameAllocator {
+public:
+    using Key = std::array<std::uint64_t, 2>;
+
+    struct State {
+        Key key{};
+        std::uint64_t end = 0; // every counter below end may have been handed out
+    };
+
+    static const std::uint64_t blockSize = 1 << 16;
+    static const std::size_t keyBytes = 16; // the key in a log record, see apply
+
+private:
+    static const int rounds = 6;
+    static const std::uint64_t halfMask = (1ull << 24) - 1;
+
+    Key key;
+    std::uint64_t roundKeys[rounds];
+    std::atomic<std::uint64_t> next{0};
+    std::atomic<std::uint64_t> reservedEnd{0};
+    std::mutex reserveMutex;
+    WriteAheadLog* log = nullptr;
+
+    static std::uint64_t space() {
+        std::uint64_t size = 1;
+        for (std::size_t i = 0; i < GeneratedName::digits; ++i) size *= GeneratedName::alphabet.size();
+        return size;
+    }
+
+    static Key randomKey() {
+        std::random_device device;
+        std::uint64_t time = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        Key result;
+        for (std::uint64_t& word : result) {
+            word = (static_cast<std::uint64_t>(device()) << 32 | device()) ^ time;
+            time *= 0x9E3779B97F4A7C15ull;
+        }
+        return result;
+    }
+
+    void setKey(const Key& newKey) {
+        key = newKey;
+        // splitmix64 over the key, one step per round
+        std::uint64_t state = key[0] ^ (key[1] * 0xD1B54A32D192ED03ull);
+        for (std::uint64_t& roundKey : roundKeys) {
+            std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            roundKey = z ^ (z >> 31);
+        }
+    }
+
+    std::uint64_t round(int i, std::uint64_t half) const {
+        std::uint64_t x = (half ^ roundKeys[i]) * 0xFF51AFD7ED558CCDull;
+        x = (x ^ (x >> 33)) * 0xC4CEB9FE1A85EC53ull;
+        return (x ^ (x >> 29)) & halfMask;
+    }
+
+    // One pass of the Feistel network, a permutation of [0, 2^48)
+    std::uint64_t encrypt(std::uint64_t value) const {
+        std::uint64_t left = value >> 24;
+        std::uint64_t right = value & halfMask;
+        for (int i = 0; i < rounds; ++i) {
+            std::uint64_t mixed = left ^ round(i, right);
+            left = right;
+            right = mixed;
+        }
+        return left << 24 | right;
+    }
+
+    // Records the block of counter before any name of it is handed out
+    void reserve(std::uint64_t counter) {
+        std::lock_guard<std::mutex> lock(reserveMutex);
+        if (counter < reservedEnd.load()) return; // another thread reserved it meanwhile
+        std::uint64_t end = (counter / blockSize + 1) * blockSize;
+        if (log != nullptr) {
+            char encodedKey[keyBytes];
+            mutationformat::putInt(mutationformat::putInt(encodedKey, key[0], 8), key[1], 8);
+            Mutation mutation;
+            mutation.kind = Mutation::reserveUsernames;
+            mutation.username = GeneratedName(end);
+            mutation.password = std::string_view(encodedKey, keyBytes);
+            log->append(mutation);
+        }
+        reservedEnd.store(end);
+    }
+
+public:
+    // A random key, for a server without a previous state
+    UsernameAllocator() {
+        setKey(randomKey());
+    }
+
+    explicit UsernameAllocator(const Key& fixedKey) {
+        setKey(fixedKey);
+    }
+
+    UsernameAllocator(const UsernameAllocator&) = delete;
+    UsernameAllocator& operator=(const UsernameAllocator&) = delete;
+
+    // The reservations go into log from now on
+    void attachLog(WriteAheadLog* writeAheadLog) {
+        log = writeAheadLog;
+    }
+
+    // The name of counter. Counters past 62^8 wrap around, after that many registrations.
+    GeneratedName nameOf(std::uint64_t counter) const {
+        std::uint64_t value = counter % space();
+        do {
+            value = encrypt(value);
+        } while (value >= space());
+        return GeneratedName(value);
+    }
+
+    // A name no earlier call returned; thread safe
+    GeneratedName allocate() {
+        std::uint64_t counter = next.fetch_add(1);
+        if (counter >= reservedEnd.load()) reserve(counter);
+        return nameOf(counter);
+    }
+
+    // For a snapshot. Read after the tables were frozen, so it covers every name in them.
+    State state() const {
+        return State{key, reservedEnd.load()};
+    }
+
+    // Continues after state, from a snapshot or a log record. Only while nothing allocates.
+    void restore(const State& restored) {
+        setKey(restored.key);
+        std::uint64_t end = std::max(reservedEnd.load(), restored.end);
+        reservedEnd.store(end);
+        next.store(end);
+    }
+
+    // Applies a reserveUsernames record; username holds the end, password the key
+    void apply(const Mutation& mutation) {
+        if (mutation.password.size() != keyBytes) return;
+        State restored;
+        restored.key = {mutationformat::getInt(mutation.password.data(), 8), mutationformat::getInt(mutation.password.data() + 8, 8)};
+        restored.end = mutation.username.packed();
+        restore(restored);
+    }
+};
+
+#endif // USERNAMEALLOCATOR_H
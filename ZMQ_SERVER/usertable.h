@@ -0,0 +1,290 @@
+#ifndef USERTABLE_H
+#define USERTABLE_H
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include "generatedname.h"
+#include "channelregistry.h"
+#include "flathashmap.h"
+#include "cowcolumn.h"
+
+// Dense id of a registration, the row of the user in its UserTable
+using UserId = std::uint32_t;
+const UserId noUser = 0xFFFFFFFFu;
+
+// Every registration (name|channel) is one row. The columns hold what the four
+// string maps of UserManager used to hold, so a user is stored once and the per-row
+// data of a lookup sits in a few flat arrays instead of separate hash nodes. Channels
+// are ChannelIds from the ChannelRegistry.
+//
+// One map resolves client names to rows: a name gives its most recent registration and
+// the earlier registrations of the name hang off it through previousOfName. A name|channel
+// lookup walks that short chain comparing channel ids, so the map needs a single entry per name.
+// The map keys on the names column, which stores every name once.
+//
+// Not thread safe, UserManager locks around it.
+class UserTable {
+public:
+    // Bits of Columns::flags
+    enum Flags : std::uint8_t {
+        loggedIn = 1,
+        hasPassword = 2
+    };
+
+    // The rows of a table without its name index. Copying it is cheap and gives a frozen
+    // point-in-time view: the chunks are shared until the table changes them (cowcolumn.h).
+    struct Columns {
+        NameColumn names;
+        CowColumn<GeneratedName> generatedUsernames;
+        CowColumn<ChannelId> channels;
+        TextColumn passwords;
+        CowColumn<std::uint8_t> flags;
+        CowColumn<UserId> previousOfName; // earlier registration of the same name, noUser for the first
+
+        std::size_t size() const {
+            return flags.size();
+        }
+
+        // Snapshot form (see snapshot.h): the fixed-size columns as stored, channels as
+        // ChannelIds of the registry at the time, then the passwords and names
+        template <typename Writer>
+        void save(Writer& out) const {
+            static_assert(std::is_trivially_copyable<GeneratedName>::value && sizeof(GeneratedName) == 8,
+                          "generated usernames are written as raw 64-bit values");
+            auto putChunks = [&](const auto& column) {
+                column.forEachChunk([&](const auto* rows, std::size_t count) {
+                    out.putBytes(rows, count * sizeof(*rows));
+                });
+            };
+            out.putInt(size(), 4);
+            putChunks(generatedUsernames);
+            putChunks(channels);
+            putChunks(flags);
+            putChunks(previousOfName);
+            saveTextColumn(out, passwords);
+            saveTextColumn(out, names);
+        }
+    };
+
+private:
+    Columns columns;
+    CowColumn<std::uint32_t> lastSeen; // eviction epoch of the last change (see UserManager::evictIfFull), not in snapshots
+    FlatHashMap<std::string_view, UserId> ids; // key = name (a view into columns.names), value = its most recent registration
+
+    UserId findIn(UserId id, ChannelId channel) const {
+        while (id != noUser && columns.channels[id] != channel) id = columns.previousOfName[id];
+        return id;
+    }
+
+    // Makes id the most recent registration, head is the map entry of its name
+    void moveToFront(UserId& head, UserId id) {
+        if (head == id) return;
+        for (UserId row = head; row != noUser; row = columns.previousOfName[row]) {
+            if (columns.previousOfName[row] == id) {
+                columns.previousOfName.write(row) = columns.previousOfName[id];
+                break;
+            }
+        }
+        columns.previousOfName.write(id) = head;
+        head = id;
+    }
+
+public:
+    std::size_t size() const {
+        return columns.size();
+    }
+
+    void reserve(std::size_t users) {
+        ids.reserve(users);
+        columns.names.reserve(users);
+        columns.generatedUsernames.reserve(users);
+        columns.channels.reserve(users);
+        columns.passwords.reserve(users);
+        columns.flags.reserve(users);
+        columns.previousOfName.reserve(users);
+        lastSeen.reserve(users);
+    }
+
+    // Registering name in a channel again gives it the new generated username, drops its
+    // password and login, and makes it the most recent registration of the name.
+    UserId add(std::string_view name, ChannelId channel, GeneratedName username) {
+        UserId* head = ids.find(name);
+        UserId id = head != nullptr ? findIn(*head, channel) : noUser;
+
+        if (id != noUser) {
+            columns.generatedUsernames.write(id) = username;
+            columns.flags.write(id) = 0;
+            moveToFront(*head, id);
+            return id;
+        }
+
+        id = static_cast<UserId>(size());
+        std::string_view stored;
+        if (head != nullptr) {
+            stored = columns.names[*head];
+            columns.names.push_back_stored(stored);
+        } else {
+            stored = columns.names.push_back(name);
+        }
+        columns.generatedUsernames.push_back(username);
+        columns.channels.push_back(channel);
+        columns.passwords.push_back({});
+        columns.flags.push_back(0);
+        lastSeen.push_back(0);
+        if (head != nullptr) {
+            columns.previousOfName.push_back(*head);
+            *head = id;
+        } else {
+            columns.previousOfName.push_back(noUser);
+            ids.tryEmplace(stored, id);
+        }
+        return id;
+    }
+
+    // Most recent registration of a client name
+    UserId find(std::string_view name) const {
+        const UserId* id = ids.find(name);
+        return id != nullptr ? *id : noUser;
+    }
+
+    // Registration of name in one channel
+    UserId find(std::string_view name, ChannelId channel) const {
+        return findIn(find(name), channel);
+    }
+
+    UserId previousRegistration(UserId id) const {
+        return columns.previousOfName[id];
+    }
+
+    std::string_view name(UserId id) const {
+        return columns.names[id];
+    }
+
+    GeneratedName generatedUsername(UserId id) const {
+        return columns.generatedUsernames[id];
+    }
+
+    ChannelId channel(UserId id) const {
+        return columns.channels[id];
+    }
+
+    void setPassword(UserId id, std::string_view password) {
+        columns.passwords.assign(id, password);
+        columns.flags.write(id) |= hasPassword;
+    }
+
+    bool isPasswordSet(UserId id) const {
+        return (columns.flags[id] & hasPassword) != 0;
+    }
+
+    std::string_view password(UserId id) const {
+        return columns.passwords[id];
+    }
+
+    bool verifyPassword(UserId id, std::string_view password) const {
+        return (columns.flags[id] & hasPassword) != 0 && columns.passwords[id] == password;
+    }
+
+    bool isLoggedIn(UserId id) const {
+        return (columns.flags[id] & loggedIn) != 0;
+    }
+
+    void setLoggedIn(UserId id, bool value) {
+        std::uint8_t& flags = columns.flags.write(id);
+        if (value) flags |= loggedIn;
+        else flags &= static_cast<std::uint8_t>(~loggedIn);
+    }
+
+    std::uint32_t lastSeenEpoch(UserId id) const {
+        return lastSeen[id];
+    }
+
+    void touch(UserId id, std::uint32_t epoch) {
+        if (lastSeen[id] != epoch) lastSeen.write(id) = epoch;
+    }
+
+    // Calls fn(id) for every logged in user, in id order
+    template <typename Fn>
+    void forEachLoggedIn(Fn&& fn) const {
+        for (std::size_t id = 0; id < size(); ++id) {
+            if (columns.flags[id] & loggedIn) fn(static_cast<UserId>(id));
+        }
+    }
+
+    // Calls fn(name, id) for every client name with its most recent registration
+    template <typename Fn>
+    void forEachName(Fn&& fn) const {
+        ids.forEach([&](std::string_view name, UserId id) {
+            fn(name, id);
+        });
+    }
+
+    // Registers name with the channel, username, password and login of row in source,
+    // as the most recent registration of name
+    UserId addCopy(std::string_view name, const UserTable& source, UserId row) {
+        UserId id = add(name, source.columns.channels[row], source.columns.generatedUsernames[row]);
+        if (source.columns.flags[row] & hasPassword) columns.passwords.assign(id, source.columns.passwords[row]);
+        columns.flags.write(id) = source.columns.flags[row];
+        lastSeen.write(id) = source.lastSeen[row];
+        return id;
+    }
+
+    // Point-in-time copy of the rows for a snapshot; later changes to the table do not reach it
+    Columns freeze() const {
+        return columns;
+    }
+
+    template <typename Writer>
+    void save(Writer& out) const {
+        columns.save(out);
+    }
+
+    // Replaces the contents with a table written by Columns::save. channelIds maps the
+    // ChannelIds in the snapshot to those of the registry now. False when the data is inconsistent.
+    template <typename Reader>
+    bool load(Reader& in, const std::vector<ChannelId>& channelIds) {
+        *this = UserTable();
+        std::size_t rows = static_cast<std::size_t>(in.getInt(4));
+        if (!in.ok() || rows * (sizeof(GeneratedName) + sizeof(ChannelId) + 1 + sizeof(UserId)) > in.remaining()) return false;
+
+        auto getChunks = [&](auto& column) {
+            column.fill(rows, [&](auto* values, std::size_t count) {
+                in.getBytes(values, count * sizeof(*values));
+            });
+        };
+        getChunks(columns.generatedUsernames);
+        getChunks(columns.channels);
+        getChunks(columns.flags);
+        getChunks(columns.previousOfName);
+        lastSeen.fill(rows, [](std::uint32_t* values, std::size_t count) {
+            std::fill(values, values + count, 0u);
+        });
+        if (!loadTextColumn(in, rows, [&](std::string_view password) { columns.passwords.push_back(password); })) return false;
+        if (!loadTextColumn(in, rows, [&](std::string_view name) { columns.names.push_back(name); })) return false;
+
+        // The most recent registration of a name is the row no other row points back to
+        std::vector<bool> isPrevious(rows);
+        for (std::size_t row = 0; row < rows; ++row) {
+            ChannelId& channel = columns.channels.write(row);
+            if (channel >= channelIds.size()) return false;
+            channel = channelIds[channel];
+            UserId previous = columns.previousOfName[row];
+            if (previous != noUser) {
+                if (previous >= rows || isPrevious[previous]) return false;
+                isPrevious[previous] = true;
+            }
+        }
+        ids.reserve(rows);
+        for (std::size_t row = 0; row < rows; ++row) {
+            if (isPrevious[row]) continue;
+            if (!ids.tryEmplace(columns.names[row], static_cast<UserId>(row)).second) return false;
+        }
+        return in.ok();
+    }
+};
+
+#endif // USERTABLE_H
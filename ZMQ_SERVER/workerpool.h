@@ -0,0 +1,91 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <zmq.hpp>
+#include "usermanager.h"
+#include "requesthandler.h"
+#include "serverstats.h"
+
+// Runs the RequestHandler on a fixed number of worker threads.
+// The receive loop only calls route(): it picks a worker from the routing key of the
+// message and forwards the zmq message to that worker over an inproc PUSH socket.
+// Worker i only gets messages whose key hashes to shard i, so it is the only thread
+// that modifies UserManager shard i (and expires its sessions), and the requests of one
+// user stay in order.
+// Replies come back on one inproc PULL socket, so the PUB socket is still only used
+// by the thread that owns it.
+class WorkerPool {
+private:
+    zmq::context_t& context;
+    UserShards& userShards;
+    ServerStats& stats;
+    std::vector<zmq::socket_t> workerSockets; // PUSH, one per worker
+    zmq::socket_t replySocket;                // PULL, fed by every worker
+    std::vector<std::thread> workers;
+
+    static std::string workerAddress(std::size_t index) {
+        return "inproc://worker-" + std::to_string(index);
+    }
+
+    void workerLoop(std::size_t index) {
+        zmq::socket_t requests{context, zmq::socket_type::pull};
+        requests.connect(workerAddress(index).c_str());
+        zmq::socket_t replies{context, zmq::socket_type::push};
+        replies.connect("inproc://replies");
+
+        RequestHandler handler(userShards, stats, "worker " + std::to_string(index), index);
+        Publish publish = [&replies](zmq::message_t&& reply) {
+            replies.send(reply);
+        };
+        requests.setsockopt(ZMQ_RCVTIMEO, RequestHandler::idleMillis);
+        bool moreExpired = false;
+        while (true) {
+            zmq::message_t request;
+            if (requests.recv(&request, moreExpired ? ZMQ_DONTWAIT : 0)) {
+                handler.handle(benthernet::view(request), publish);
+            }
+            moreExpired = handler.expireSessions();
+        }
+    }
+
+public:
+    WorkerPool(zmq::context_t& ctx, UserShards& shards, ServerStats& serverStats)
+        : context(ctx), userShards(shards), stats(serverStats), replySocket(ctx, zmq::socket_type::pull)
+    {
+        // Bind everything before the workers connect to it
+        replySocket.bind("inproc://replies");
+        workerSockets.reserve(userShards.size());
+        for (std::size_t i = 0; i < userShards.size(); ++i) {
+            workerSockets.emplace_back(context, zmq::socket_type::push);
+            workerSockets.back().bind(workerAddress(i).c_str());
+        }
+    }
+
+    ~WorkerPool() {
+        for (auto& worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+    }
+
+    void start() {
+        for (std::size_t i = 0; i < workerSockets.size(); ++i) {
+            workers.emplace_back(&WorkerPool::workerLoop, this, i);
+        }
+        std::cout << "[Server] " << workers.size() << " workers gestart" << std::endl;
+    }
+
+    // Hands the request to the worker owning its routing key. The message is moved, not copied.
+    void route(zmq::message_t& request) {
+        std::size_t index = userShards.shardFor(benthernet::routingKeyOf(benthernet::view(request)));
+        workerSockets[index].send(request);
+    }
+
+    zmq::socket_t& replies() {
+        return replySocket;
+    }
+};
+
+#endif // WORKERPOOL_H
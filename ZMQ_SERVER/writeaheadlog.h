@@ -0,0 +1,288 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include "mutation.h"
+#include "serverstats.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Forces what was written to file onto the disk; false when the OS reports an error
+inline bool syncToDisk(std::FILE* file) {
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// When the log is forced to disk
+enum class SyncMode {
+    off,      // only written to the OS; a crash of the machine can lose the last records
+    batch,    // fsync after every batch (group commit)
+    interval  // fsync at most every syncInterval
+};
+
+// Append-only binary log of the UserManager mutations (record format in mutation.h).
+// append() only copies the record into a pending buffer under a short lock; a writer
+// thread takes the whole buffer, checksums, writes and syncs it as one batch. Everything appended
+// while a batch is being written or synced goes into the next one (group commit), so the
+// handle threads never wait for the disk.
+//
+// Once woken the writer lets records collect for groupWindow before it takes them, unless
+// the buffer fills up first. Without that window it wakes for nearly every record at low
+// load and each record costs a write() call and a thread switch on the handle thread's core.
+//
+// A batch that fails to write (a full disk, an I/O error) is cut off the file again and kept;
+// the writer tries it again, together with what was appended since, every retryInterval. Until
+// it succeeds the written position stays before it, so snapshots and followers wait for it.
+class WriteAheadLog {
+private:
+    static constexpr std::chrono::microseconds groupWindow{1000};
+    static constexpr std::chrono::milliseconds retryInterval{1000};
+    static const std::size_t fullBatch = 1 << 20; // bytes that end the window early
+
+    std::string path;
+    std::FILE* file = nullptr;
+    SyncMode syncMode;
+    std::chrono::milliseconds syncInterval;
+
+    std::mutex pendingMutex;
+    std::condition_variable wakeWriter;
+    std::string pending; // records not yet handed to the writer
+    std::uint64_t appended = 0; // log position after the last appended record
+    std::uint64_t written = 0;  // log position up to which the writer has written the records
+    std::condition_variable wroteBatch;
+    bool stopping = false;
+    std::thread writer;
+
+    ServerStats& stats;
+    std::size_t statsSection;
+
+    std::atomic<std::uint64_t> records{0};
+    std::atomic<std::uint64_t> batches{0};
+    std::atomic<std::uint64_t> bytesWritten{0};
+    std::atomic<std::uint64_t> syncs{0};
+    std::atomic<std::uint64_t> failures{0};
+    std::uint64_t last[4] = {}; // counters at the previous report, only used by the reporter
+
+    bool syncFile() {
+        syncs.fetch_add(1, std::memory_order_relaxed);
+        if (syncToDisk(file)) return true;
+        failures.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "[WAL] fsync van " << path << " mislukt" << std::endl;
+        return false;
+    }
+
+    // Writes the batch after the records at position end (and syncs it in batch mode). On a
+    // failure the file is cut back to end, so the batch can be written again as a whole.
+    bool writeBatch(const std::string& batch, std::uint64_t end) {
+        bool ok = std::fwrite(batch.data(), 1, batch.size(), file) == batch.size() && std::fflush(file) == 0;
+        if (!ok) {
+            failures.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "[WAL] Schrijven van " << batch.size() << " bytes naar " << path << " mislukt" << std::endl;
+        } else if (syncMode == SyncMode::batch) {
+            ok = syncFile();
+        }
+        if (ok) return true;
+        std::clearerr(file);
+        std::error_code error;
+        std::filesystem::resize_file(path, end, error);
+        if (error) std::cerr << "[WAL] Afkappen van " << path << " tot " << end << " bytes mislukt" << std::endl;
+        return false;
+    }
+
+    void writeLoop() {
+        std::string batch;
+        bool unsynced = false;
+        auto lastSync = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock(pendingMutex);
+        while (true) {
+            if (!batch.empty()) {
+                wakeWriter.wait_for(lock, retryInterval, [this] { return stopping; }); // the failed batch
+            } else if (unsynced) {
+                wakeWriter.wait_until(lock, lastSync + syncInterval, [this] { return stopping || !pending.empty(); });
+            } else {
+                wakeWriter.wait(lock, [this] { return stopping || !pending.empty(); });
+            }
+            if (!stopping && !pending.empty()) {
+                wakeWriter.wait_for(lock, groupWindow, [this] { return stopping || pending.size() >= fullBatch; });
+            }
+            bool stop = stopping;
+            if (batch.empty()) {
+                batch.swap(pending);
+            } else {
+                batch += pending;
+                pending.clear();
+            }
+            std::uint64_t batchEnd = appended;
+            std::uint64_t batchStart = written; // only the writer changes it
+            lock.unlock();
+
+            bool ok = true;
+            if (!batch.empty()) {
+                std::size_t sealed = mutationformat::seal(&batch[0], batch.size());
+                ok = writeBatch(batch, batchStart);
+                if (ok) {
+                    records.fetch_add(sealed, std::memory_order_relaxed);
+                    batches.fetch_add(1, std::memory_order_relaxed);
+                    bytesWritten.fetch_add(batch.size(), std::memory_order_relaxed);
+                    batch.clear();
+                    unsynced = syncMode == SyncMode::interval;
+                } else if (stop) {
+                    std::cerr << "[WAL] " << batch.size() << " bytes aan records gaan verloren" << std::endl;
+                }
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (unsynced && (stop || now - lastSync >= syncInterval)) {
+                // A failed sync is tried again at the next interval
+                unsynced = !syncFile();
+                lastSync = now;
+            }
+
+            lock.lock();
+            if (ok) written = batchEnd;
+            wroteBatch.notify_all();
+            if (stop && pending.empty()) return;
+        }
+    }
+
+    void printStats(std::ostream& out, double seconds) {
+        std::uint64_t now[4] = {records.load(), batches.load(), bytesWritten.load(), syncs.load()};
+        std::uint64_t delta[4];
+        for (int i = 0; i < 4; ++i) {
+            delta[i] = now[i] - last[i];
+            last[i] = now[i];
+        }
+        out << "  [wal] " << std::fixed << std::setprecision(0)
+            << delta[0] / seconds << " records/s, "
+            << delta[1] / seconds << " batches/s ("
+            << (delta[1] > 0 ? static_cast<double>(delta[0]) / delta[1] : 0.0) << " records/batch), "
+            << delta[2] / seconds / 1024.0 << " KB/s, "
+            << delta[3] / seconds << " fsyncs/s, " << failures.load() << " schrijffouten" << std::endl;
+    }
+
+public:
+    WriteAheadLog(const std::string& logPath, SyncMode mode, std::chrono::milliseconds interval, ServerStats& serverStats)
+        : path(logPath), syncMode(mode), syncInterval(interval), stats(serverStats) {
+        std::error_code error;
+        std::uintmax_t size = std::filesystem::file_size(path, error);
+        appended = written = error ? 0 : static_cast<std::uint64_t>(size);
+        file = std::fopen(path.c_str(), "ab");
+        if (file == nullptr) {
+            std::cerr << "[WAL] Kan log niet openen: " << path << std::endl;
+        } else {
+            writer = std::thread(&WriteAheadLog::writeLoop, this);
+        }
+        statsSection = stats.addSection([this](std::ostream& out, double seconds) {
+            printStats(out, seconds);
+        });
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Writes and syncs what is still pending
+    ~WriteAheadLog() {
+        stats.removeSection(statsSection);
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            stopping = true;
+        }
+        wakeWriter.notify_one();
+        if (writer.joinable()) writer.join();
+        if (file != nullptr) std::fclose(file);
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // Position in the log file after the last record appended so far
+    std::uint64_t position() {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        return appended;
+    }
+
+    // Position up to which the records are in the file (written, not necessarily synced)
+    std::uint64_t writtenPosition() {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        return written;
+    }
+
+    // Waits until the writer has written (and in batch mode synced) the log up to position
+    void waitUntilWritten(std::uint64_t position) {
+        std::unique_lock<std::mutex> lock(pendingMutex);
+        wroteBatch.wait(lock, [&] { return written >= position || file == nullptr; });
+    }
+
+    void append(const Mutation& mutation) {
+        if (file == nullptr) return;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            std::size_t before = pending.size();
+            mutationformat::encodeUnsealed(mutation, pending);
+            appended += pending.size() - before;
+            // The writer only needs a signal when the buffer becomes non-empty or full
+            wake = before == 0 || (before < fullBatch && pending.size() >= fullBatch);
+        }
+        if (wake) wakeWriter.notify_one();
+    }
+
+    // Calls apply(const Mutation&) for every record in the log at path from byte offset on,
+    // in order, and returns the number of records; offset is moved to the end of the last one.
+    // A record the server was still writing when it stopped fails its checksum: the log is
+    // cut off there, so new records follow the last good one.
+    template <typename Fn>
+    static std::size_t replay(const std::string& path, std::uint64_t& offset, Fn&& apply) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return 0;
+        std::uint64_t fileSize = static_cast<std::uint64_t>(in.tellg());
+        if (fileSize < offset) {
+            // Not the log the snapshot was taken from: everything in it is newer
+            std::cerr << "[WAL] Log is korter dan het snapshot punt, hele log wordt afgespeeld" << std::endl;
+            offset = 0;
+        }
+        in.seekg(static_cast<std::streamoff>(offset));
+        std::string data(static_cast<std::size_t>(fileSize - offset), '\0');
+        in.read(&data[0], static_cast<std::streamsize>(data.size()));
+        data.resize(static_cast<std::size_t>(in.gcount()));
+        in.close();
+
+        std::size_t count = 0;
+        std::size_t pos = 0;
+        Mutation mutation;
+        while (std::size_t size = mutationformat::decode(data.data() + pos, data.size() - pos, mutation)) {
+            apply(static_cast<const Mutation&>(mutation));
+            pos += size;
+            ++count;
+        }
+        if (pos < data.size()) {
+            std::cerr << "[WAL] " << (data.size() - pos) << " bytes na record " << count
+                      << " zijn onvolledig, log wordt ingekort" << std::endl;
+            std::error_code error;
+            std::filesystem::resize_file(path, offset + pos, error);
+        }
+        offset += pos;
+        return count;
+    }
+};
+
+#endif // WRITEAHEADLOG_H
@@ -0,0 +1,115 @@
+// Change events of the server (ZMQ_SERVER --changes), declared once for the server and the
+// tools that consume them. Unlike the replies on the PUB socket these carry no text meant for
+// people: every event is one state change with a sequence number, in a compact binary form.
+//
+// A consumer connects a DEALER socket to the change endpoint and fetches batches:
+//   fetch 'F' | u64 from | u32 max events
+//   batch 'B' | u64 stream | u64 oldest | u64 next | events, at most max of them
+// The batch holds the events from sequence from on (from the oldest one the server still has
+// when from is older, or 0). It is sent as soon as there are such events, else after a second
+// without any; fetch with max 0 to learn next without waiting. A consumer keeps next as its
+// cursor and fetches from it again, also after a reconnect. Events before oldest have been
+// dropped from the bounded backlog. stream changes when the server restarts and its sequence
+// numbers start over: a consumer that sees another stream fetches from 0.
+//
+// All integers little endian.
+//   event u64 sequence | u64 time (ms since the epoch) | u8 kind
+//         | u16 name size | name | u16 channel size | channel | u16 value size | value
+
+#ifndef BENTHERNET_CHANGES_HPP
+#define BENTHERNET_CHANGES_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace benthernet {
+
+struct ChangeEvent {
+    enum Kind : std::uint8_t {
+        registered = 1,  // name, channel, value = the generated username
+        passwordSet = 2, // name, channel (the password itself is not in the stream)
+        login = 3,       // name, channel
+        logout = 4,      // name, channel; also when the session expired
+        chatPosted = 5   // name = sender, channel, value = the text
+    };
+
+    std::uint64_t sequence = 0;
+    std::uint64_t time = 0;
+    Kind kind = registered;
+    std::string_view name;
+    std::string_view channel;
+    std::string_view value;
+};
+
+namespace changeformat {
+
+const char fetchMessage = 'F';
+const char batchMessage = 'B';
+const std::size_t fetchSize = 13;
+const std::size_t batchHeaderSize = 25;
+
+inline char* putInt(char* out, std::uint64_t value, std::size_t bytes) {
+    for (std::size_t i = 0; i < bytes; ++i) out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    return out + bytes;
+}
+
+inline std::uint64_t getInt(const char* data, std::size_t bytes) {
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < bytes; ++i) value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    return value;
+}
+
+// Texts longer than a u16 size are cut off
+inline std::string_view clip(std::string_view text) {
+    return text.substr(0, 0xFFFF);
+}
+
+// Appends the event to out
+inline void encode(const ChangeEvent& event, std::string& out) {
+    std::string_view texts[] = {clip(event.name), clip(event.channel), clip(event.value)};
+    std::size_t start = out.size();
+    out.resize(start + 17 + 6 + texts[0].size() + texts[1].size() + texts[2].size());
+    char* pos = &out[start];
+    pos = putInt(pos, event.sequence, 8);
+    pos = putInt(pos, event.time, 8);
+    *pos++ = static_cast<char>(event.kind);
+    for (std::string_view text : texts) {
+        pos = putInt(pos, text.size(), 2);
+        std::memcpy(pos, text.data(), text.size());
+        pos += text.size();
+    }
+}
+
+// Decodes the event at the start of data (its views point into data).
+// Returns the size of the event, or 0 when data does not start with a complete event.
+inline std::size_t decode(const char* data, std::size_t size, ChangeEvent& event) {
+    if (size < 17) return 0;
+    event.sequence = getInt(data, 8);
+    event.time = getInt(data + 8, 8);
+    event.kind = static_cast<ChangeEvent::Kind>(static_cast<std::uint8_t>(data[16]));
+    std::size_t pos = 17;
+    for (std::string_view* text : {&event.name, &event.channel, &event.value}) {
+        if (pos + 2 > size) return 0;
+        std::size_t length = static_cast<std::size_t>(getInt(data + pos, 2));
+        pos += 2;
+        if (pos + length > size) return 0;
+        *text = std::string_view(data + pos, length);
+        pos += length;
+    }
+    return pos;
+}
+
+inline std::string encodeFetch(std::uint64_t from, std::uint32_t maxEvents) {
+    std::string message(fetchSize, '\0');
+    message[0] = fetchMessage;
+    putInt(putInt(&message[1], from, 8), maxEvents, 4);
+    return message;
+}
+
+} // namespace changeformat
+
+} // namespace benthernet
+
+#endif // BENTHERNET_CHANGES_HPP
@@ -0,0 +1,59 @@
+// Zero-copy decoding of Benthernet messages straight from a zmq::message_t.
+//
+// The views returned here point into the buffer of the zmq message, so they are valid
+// for as long as that message is alive and not rebuilt. Nothing is copied and nothing
+// is allocated: keep the message around instead of turning it into a std::string.
+
+#ifndef BENTHERNET_CODEC_HPP
+#define BENTHERNET_CODEC_HPP
+
+#include <string_view>
+#include <zmq.hpp>
+#include "messages.hpp"
+
+namespace benthernet {
+
+// The whole message as text
+inline std::string_view view(const zmq::message_t& message) {
+    return std::string_view(message.data<char>(), message.size());
+}
+
+// Topic of a message: "chat>", "chat!>", or "service>name?>" / "service>name!>"
+inline std::string_view topicOf(std::string_view message) {
+    std::size_t end = message.find('>');
+    if (end == std::string_view::npos) return {};
+    if (message.compare(0, end + 1, "service>") == 0) {
+        end = message.find('>', end + 1);
+        if (end == std::string_view::npos) return {};
+    }
+    return message.substr(0, end + 1);
+}
+
+// Decodes the message as Message, see Schema::decode for the return value
+template <typename Message>
+std::size_t decode(const zmq::message_t& message, typename Message::Fields& fields) {
+    return Message::decode(view(message), fields);
+}
+
+// The client name at the start of a service request body: the part before '|'. Names never
+// contain '|' (a registration splits name|channel at it); the server picks the shard of a
+// request by this name both in routingKeyOf and in the handlers, so they always agree.
+inline std::string_view clientNameOf(std::string_view body) {
+    return body.substr(0, body.find('|'));
+}
+
+// Key that decides which worker handles a request, without decoding the whole message:
+// the client name of service requests (see clientNameOf) and the channel of chat messages.
+inline std::string_view routingKeyOf(std::string_view message) {
+    if (ChatRequest::matches(message)) {
+        std::string_view body = message.substr(ChatRequest::topic.size());
+        return body.substr(0, body.find('>'));
+    }
+    std::size_t pos = message.find("?>");
+    if (pos == std::string_view::npos) return {};
+    return clientNameOf(message.substr(pos + 2));
+}
+
+} // namespace benthernet
+
+#endif // BENTHERNET_CODEC_HPP
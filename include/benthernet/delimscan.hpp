@@ -0,0 +1,173 @@
+// Vectorized scanner for the field separators of Benthernet messages.
+//
+// scanDelimiters() walks a buffer once and writes the offsets of every byte equal to one
+// of two delimiter characters ('>' and '|' in practice) into an offset array, stopping
+// early once the array is full. The kernel is picked once at startup: AVX2 (32 bytes per
+// step) or SSE2 (16 bytes per step) on x86 when the CPU has it, a scalar loop otherwise.
+
+#ifndef BENTHERNET_DELIMSCAN_HPP
+#define BENTHERNET_DELIMSCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BENTHERNET_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace benthernet {
+
+// Signature shared by every kernel: returns the number of offsets written (<= maxHits)
+using ScanKernel = std::size_t (*)(const char* data, std::size_t size, char first, char second,
+                                   std::uint32_t* offsets, std::size_t maxHits);
+
+namespace detail {
+
+// Scalar scan of data[start, size), continuing an offset array that already holds hits entries
+inline std::size_t scanScalarFrom(const char* data, std::size_t start, std::size_t size, char first, char second,
+                                  std::uint32_t* offsets, std::size_t hits, std::size_t maxHits) {
+    for (std::size_t i = start; i < size && hits < maxHits; ++i) {
+        if (data[i] == first || data[i] == second) offsets[hits++] = static_cast<std::uint32_t>(i);
+    }
+    return hits;
+}
+
+} // namespace detail
+
+inline std::size_t scanDelimitersScalar(const char* data, std::size_t size, char first, char second,
+                                        std::uint32_t* offsets, std::size_t maxHits) {
+    return detail::scanScalarFrom(data, 0, size, first, second, offsets, 0, maxHits);
+}
+
+#ifdef BENTHERNET_SCAN_X86
+
+namespace detail {
+
+// Appends the set bits of mask (relative to base) to offsets. Returns false once maxHits is reached.
+inline bool collectHits(std::uint32_t mask, std::size_t base, std::uint32_t* offsets,
+                        std::size_t& hits, std::size_t maxHits) {
+    while (mask != 0) {
+        offsets[hits++] = static_cast<std::uint32_t>(base + __builtin_ctz(mask));
+        if (hits == maxHits) return false;
+        mask &= mask - 1;
+    }
+    return true;
+}
+
+} // namespace detail
+
+__attribute__((target("sse2")))
+inline std::size_t scanDelimitersSse2(const char* data, std::size_t size, char first, char second,
+                                      std::uint32_t* offsets, std::size_t maxHits) {
+    std::size_t hits = 0;
+    if (maxHits == 0) return 0;
+    const __m128i a = _mm_set1_epi8(first);
+    const __m128i b = _mm_set1_epi8(second);
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i match = _mm_or_si128(_mm_cmpeq_epi8(chunk, a), _mm_cmpeq_epi8(chunk, b));
+        std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(match));
+        if (mask != 0 && !detail::collectHits(mask, i, offsets, hits, maxHits)) return hits;
+    }
+    return detail::scanScalarFrom(data, i, size, first, second, offsets, hits, maxHits);
+}
+
+__attribute__((target("avx2")))
+inline std::size_t scanDelimitersAvx2(const char* data, std::size_t size, char first, char second,
+                                      std::uint32_t* offsets, std::size_t maxHits) {
+    std::size_t hits = 0;
+    if (maxHits == 0) return 0;
+    const __m256i a = _mm256_set1_epi8(first);
+    const __m256i b = _mm256_set1_epi8(second);
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i match = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, a), _mm256_cmpeq_epi8(chunk, b));
+        std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(match));
+        if (mask != 0 && !detail::collectHits(mask, i, offsets, hits, maxHits)) return hits;
+    }
+    if (i + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i match = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(a)),
+                                     _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(b)));
+        std::uint32_t mask = static_cast<std::uint32_t>(_mm_movemask_epi8(match));
+        if (mask != 0 && !detail::collectHits(mask, i, offsets, hits, maxHits)) return hits;
+        i += 16;
+    }
+    return detail::scanScalarFrom(data, i, size, first, second, offsets, hits, maxHits);
+}
+
+#endif // BENTHERNET_SCAN_X86
+
+// Best kernel for this CPU, looked up once
+inline ScanKernel selectScanKernel() {
+#ifdef BENTHERNET_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scanDelimitersAvx2;
+    if (__builtin_cpu_supports("sse2")) return scanDelimitersSse2;
+#endif
+    return scanDelimitersScalar;
+}
+
+inline const char* scanKernelName() {
+#ifdef BENTHERNET_SCAN_X86
+    ScanKernel kernel = selectScanKernel();
+    if (kernel == scanDelimitersAvx2) return "avx2";
+    if (kernel == scanDelimitersSse2) return "sse2";
+#endif
+    return "scalar";
+}
+
+inline std::size_t scanDelimiters(const char* data, std::size_t size, char first, char second,
+                                  std::uint32_t* offsets, std::size_t maxHits) {
+    static const ScanKernel kernel = selectScanKernel();
+    return kernel(data, size, first, second, offsets, maxHits);
+}
+
+// Walks the separators of a message front to back for Schema::decode. It scans in small
+// batches, only as many delimiters as the schema still needs, so a long chat text after
+// the last separator is never read.
+template <char First, char Second>
+class DelimiterCursor {
+private:
+    static const std::size_t batchSize = 16;
+
+    const char* data;
+    std::size_t size;
+    std::uint32_t offsets[batchSize];
+    std::size_t count = 0;   // offsets in the current batch
+    std::size_t index = 0;   // next offset to look at
+    std::size_t scanned = 0; // everything before this position has been scanned
+
+public:
+    DelimiterCursor(const char* messageData, std::size_t messageSize)
+        : data(messageData), size(messageSize) {}
+
+    // Position of the first separator equal to c at or after from, or size when there is none.
+    // wanted = how many separators the caller still needs, so the scan can stop early.
+    std::size_t next(char c, std::size_t from, std::size_t wanted) {
+        while (true) {
+            for (; index < count; ++index) {
+                std::size_t pos = offsets[index];
+                if (pos >= from && data[pos] == c) {
+                    ++index;
+                    return pos;
+                }
+            }
+            if (scanned >= size) return size;
+
+            std::size_t start = scanned > from ? scanned : from;
+            std::size_t maxHits = wanted < batchSize ? wanted : batchSize;
+            count = scanDelimiters(data + start, size - start, First, Second, offsets, maxHits);
+            index = 0;
+            for (std::size_t i = 0; i < count; ++i) offsets[i] += static_cast<std::uint32_t>(start);
+            scanned = count == maxHits ? offsets[count - 1] + 1 : size;
+        }
+    }
+};
+
+} // namespace benthernet
+
+#endif // BENTHERNET_DELIMSCAN_HPP
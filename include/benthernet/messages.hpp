@@ -0,0 +1,123 @@
+// Every message of the Benthernet username service, declared once for client and server.
+// The enum in each message names its fields: fields[LoginRequest::password].
+
+#ifndef BENTHERNET_MESSAGES_HPP
+#define BENTHERNET_MESSAGES_HPP
+
+#include <string_view>
+#include "schema.hpp"
+
+namespace benthernet {
+
+// service>username?>name|channel
+struct UsernameRequest : Schema<UsernameRequest, noTerminator, '|'> {
+    static constexpr std::string_view topic{"service>username?>"};
+    enum { name, channel };
+};
+
+// service>username!>name|channel>je bent geregistreerd als: User_XXXXXXXX>
+struct UsernameReply : Schema<UsernameReply, '>', '|', '>'> {
+    static constexpr std::string_view topic{"service>username!>"};
+    enum { name, channel, text };
+};
+
+// service>password?>name|length
+struct PasswordRequest : Schema<PasswordRequest, noTerminator, '|'> {
+    static constexpr std::string_view topic{"service>password?>"};
+    enum { name, length };
+};
+
+// service>password!>name|length>Je wachtwoord is: password>
+struct PasswordReply : Schema<PasswordReply, '>', '|', '>'> {
+    static constexpr std::string_view topic{"service>password!>"};
+    enum { name, length, text };
+};
+
+// service>password!>name>error>
+struct PasswordError : Schema<PasswordError, '>', '>'> {
+    static constexpr std::string_view topic{"service>password!>"};
+    enum { name, text };
+};
+
+// service>login?>name|password
+struct LoginRequest : Schema<LoginRequest, noTerminator, '|'> {
+    static constexpr std::string_view topic{"service>login?>"};
+    enum { name, password };
+};
+
+// service>login!>name>result>
+struct LoginReply : Schema<LoginReply, '>', '>'> {
+    static constexpr std::string_view topic{"service>login!>"};
+    enum { name, text };
+};
+
+// service>logout?>name
+struct LogoutRequest : Schema<LogoutRequest, noTerminator> {
+    static constexpr std::string_view topic{"service>logout?>"};
+    enum { name };
+};
+
+// service>logout!>name>result>
+struct LogoutReply : Schema<LogoutReply, '>', '>'> {
+    static constexpr std::string_view topic{"service>logout!>"};
+    enum { name, text };
+};
+
+// service>heartbeat?>name, keeps the session of a logged in name alive
+struct HeartbeatRequest : Schema<HeartbeatRequest, noTerminator> {
+    static constexpr std::string_view topic{"service>heartbeat?>"};
+    enum { name };
+};
+
+// service>heartbeat!>name>result>, only sent when name has no session (anymore)
+struct HeartbeatReply : Schema<HeartbeatReply, '>', '>'> {
+    static constexpr std::string_view topic{"service>heartbeat!>"};
+    enum { name, text };
+};
+
+// service>game?>name|channel, the server echoes the user part as it was sent
+struct GameRequest : Schema<GameRequest, noTerminator> {
+    static constexpr std::string_view topic{"service>game?>"};
+    enum { user };
+};
+
+// service>game!>name|channel>Random game is: game>
+struct GameReply : Schema<GameReply, '>', '>'> {
+    static constexpr std::string_view topic{"service>game!>"};
+    enum { user, text };
+};
+
+// service>clients?>
+struct ClientsRequest : Schema<ClientsRequest, noTerminator> {
+    static constexpr std::string_view topic{"service>clients?>"};
+    enum { unused };
+};
+
+// service>clients!>list>
+struct ClientsReply : Schema<ClientsReply, '>'> {
+    static constexpr std::string_view topic{"service>clients!>"};
+    enum { text };
+};
+
+// chat>channel>sender>text
+struct ChatRequest : Schema<ChatRequest, noTerminator, '>', '>'> {
+    static constexpr std::string_view topic{"chat>"};
+    enum { channel, sender, text };
+};
+
+// chat!>channel>sender>text
+struct ChatBroadcast : Schema<ChatBroadcast, noTerminator, '>', '>'> {
+    static constexpr std::string_view topic{"chat!>"};
+    enum { channel, sender, text };
+};
+
+// Reply texts that the client reads back
+constexpr std::string_view registeredAsText{"je bent geregistreerd als: "};
+constexpr std::string_view passwordIsText{"Je wachtwoord is: "};
+constexpr std::string_view loginSucceededText{"Succesvol ingelogd"};
+constexpr std::string_view randomGameText{"Random game is: "};
+constexpr std::string_view sessionExpiredText{"Sessie verlopen"};
+
+} // namespace benthernet
+
+#endif // BENTHERNET_MESSAGES_HPP
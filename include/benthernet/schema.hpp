@@ -0,0 +1,181 @@
+// Compile-time message schemas for the Benthernet protocol.
+//
+// A message is a topic followed by fields, separated by fixed characters and optionally
+// closed by a terminator, e.g.
+//
+//     service>password!>name|length>text>
+//     \_______________/ \__/ \____/ \__/
+//          topic       field  field field   separators '|' '>', terminator '>'
+//
+// A schema lists exactly that as template arguments. decode() and encode() are
+// instantiated per schema, so the separators are constants in the generated code and
+// nothing interprets a format string at run time. Decoding returns string_views into
+// the message and never allocates; the separators are located with the vectorized
+// scanner from delimscan.hpp.
+
+#ifndef BENTHERNET_SCHEMA_HPP
+#define BENTHERNET_SCHEMA_HPP
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include "delimscan.hpp"
+
+namespace benthernet {
+
+// Terminator value for messages that simply end after their last field
+constexpr char noTerminator = '\0';
+
+namespace detail {
+
+inline std::string_view piece(std::string_view text) { return text; }
+inline char piece(char c) { return c; }
+
+} // namespace detail
+
+// Several pieces written as one field, e.g. concat("Je wachtwoord is: ", password).
+// The pieces are views: the arguments must outlive the encode() call.
+template <typename... Pieces>
+struct Concat {
+    std::tuple<Pieces...> pieces;
+};
+
+template <typename... Args>
+constexpr auto concat(const Args&... args) {
+    return Concat<decltype(detail::piece(args))...>{{detail::piece(args)...}};
+}
+
+namespace detail {
+
+inline std::size_t pieceSize(std::string_view piece) { return piece.size(); }
+inline std::size_t pieceSize(char) { return 1; }
+template <typename... Pieces>
+std::size_t pieceSize(const Concat<Pieces...>& value) {
+    return std::apply([](const auto&... piece) { return (std::size_t{0} + ... + pieceSize(piece)); }, value.pieces);
+}
+
+template <typename Out>
+void appendPiece(Out& out, std::string_view piece) { out.append(piece.data(), piece.size()); }
+template <typename Out>
+void appendPiece(Out& out, char piece) { out.push_back(piece); }
+template <typename Out, typename... Pieces>
+void appendPiece(Out& out, const Concat<Pieces...>& value) {
+    std::apply([&out](const auto&... piece) { (appendPiece(out, piece), ...); }, value.pieces);
+}
+
+} // namespace detail
+
+// Message describes one message type: it derives from Schema and defines
+//     static constexpr std::string_view topic = "...";
+// Out (the encode target) needs append(const char*, size_t) and push_back(char),
+// std::string qualifies.
+template <typename Message, char Terminator, char... Separators>
+struct Schema {
+    static constexpr std::size_t fieldCount = sizeof...(Separators) + 1;
+    static constexpr std::array<char, sizeof...(Separators)> separators{{Separators...}};
+
+    using Fields = std::array<std::string_view, fieldCount>;
+
+    // The scanner looks for at most two different characters at once
+    static constexpr char delimiter(std::size_t which) {
+        char found[2] = {noTerminator, noTerminator};
+        std::size_t distinct = 0;
+        for (std::size_t i = 0; i < separators.size(); ++i) {
+            char c = separators[i];
+            if ((distinct > 0 && c == found[0]) || (distinct > 1 && c == found[1])) continue;
+            if (distinct < 2) found[distinct] = c;
+            ++distinct;
+        }
+        if (distinct > 2) return noTerminator;
+        return which == 0 || distinct < 2 ? found[0] : found[1];
+    }
+    static_assert(sizeof...(Separators) == 0 || delimiter(0) != noTerminator,
+                  "a schema can use at most two different separator characters");
+
+    using Cursor = DelimiterCursor<delimiter(0), delimiter(1)>;
+
+    static constexpr bool matches(std::string_view message) {
+        return message.substr(0, Message::topic.size()) == Message::topic;
+    }
+
+    // Splits the message into its fields and returns how many of them were present:
+    // 0 when the topic does not match, fieldCount when every separator was found.
+    // When a separator is missing, the current field gets the rest of the message and
+    // the fields after it stay empty.
+    static std::size_t decode(std::string_view message, Fields& fields) {
+        if (!matches(message)) return 0;
+
+        std::string_view body = message.substr(Message::topic.size());
+        if constexpr (Terminator != noTerminator) {
+            if (!body.empty() && body.back() == Terminator) body.remove_suffix(1);
+        }
+        fields = Fields{};
+        return split(body, fields, std::make_index_sequence<fieldCount - 1>{});
+    }
+
+    // Number of bytes encode() writes for these fields
+    template <typename... Args>
+    static std::size_t encodedSize(const Args&... args) {
+        static_assert(sizeof...(Args) == fieldCount, "wrong number of fields for this message");
+        return Message::topic.size() + (std::size_t{0} + ... + detail::pieceSize(args))
+            + sizeof...(Separators) + (Terminator != noTerminator ? 1 : 0);
+    }
+
+    template <typename Out, typename... Args>
+    static void encode(Out& out, const Args&... args) {
+        static_assert(sizeof...(Args) == fieldCount, "wrong number of fields for this message");
+        detail::appendPiece(out, Message::topic);
+        encodeFields(out, std::index_sequence_for<Args...>{}, args...);
+        if constexpr (Terminator != noTerminator) out.push_back(Terminator);
+    }
+
+    template <typename... Args>
+    static std::string toString(const Args&... args) {
+        std::string message;
+        message.reserve(encodedSize(args...));
+        encode(message, args...);
+        return message;
+    }
+
+private:
+    // Cuts field I off at separator I. Returns false when the separator is missing.
+    template <std::size_t I>
+    static bool take(Cursor& cursor, std::string_view body, Fields& fields, std::size_t& pos) {
+        std::size_t end = cursor.next(separators[I], pos, sizeof...(Separators) - I);
+        if (end == body.size()) {
+            fields[I] = body.substr(pos);
+            return false;
+        }
+        fields[I] = body.substr(pos, end - pos);
+        pos = end + 1;
+        return true;
+    }
+
+    template <std::size_t... I>
+    static std::size_t split(std::string_view body, Fields& fields, std::index_sequence<I...>) {
+        Cursor cursor(body.data(), body.size());
+        std::size_t pos = 0;
+        std::size_t present = 1;
+        if (((take<I>(cursor, body, fields, pos) && ++present) && ...)) {
+            fields[fieldCount - 1] = body.substr(pos);
+        }
+        return present;
+    }
+
+    template <std::size_t I, typename Out>
+    static void appendSeparator(Out& out) {
+        if constexpr (I < sizeof...(Separators)) out.push_back(separators[I]);
+    }
+
+    template <typename Out, std::size_t... I, typename... Args>
+    static void encodeFields(Out& out, std::index_sequence<I...>, const Args&... args) {
+        ((detail::appendPiece(out, args), appendSeparator<I>(out)), ...);
+    }
+};
+
+} // namespace benthernet
+
+#endif // BENTHERNET_SCHEMA_HPP